@@ -0,0 +1,109 @@
+#include "Audio.h"
+
+#include <string.h>
+
+Audio* Audio::instance = nullptr;
+
+Audio::Audio() : mixer() {
+  instance = this;
+  hal_audio_init(AUDIO_PIN, AUDIO_SAMPLE_RATE, fill);
+}
+
+Audio& Audio::getInstance() {
+  static Audio audio;
+  return audio;
+}
+
+// Main loop only, false when the queue is full and the sound is dropped
+bool Audio::play(const SOUNDS sound) {
+  return mixer.play(sound);
+}
+
+void Audio::fill(uint16_t* samples, uint count) {
+  instance->mixer.mix(samples, count);
+}
+
+AudioMixer::AudioMixer() : queue(), voices(), next_voice(0) {}
+
+bool AudioMixer::play(const SOUNDS sound) {
+  return queue.push(sound);
+}
+
+void AudioMixer::mix(uint16_t* samples, const uint count) {
+  uint8_t sound;
+  while (queue.pop(sound)) {
+    start((SOUNDS)sound);
+  }
+
+  memset(samples, 0, count * sizeof(uint16_t));
+  for (audio_voice_t& voice : voices) {
+    if (voice.sound != nullptr) {
+      mixVoice(voice, samples, count);
+    }
+  }
+  for (uint i = 0; i < count; i++) {
+    samples[i] = samples[i] < HAL_AUDIO_LEVELS ? samples[i] : HAL_AUDIO_LEVELS - 1;
+  }
+}
+
+void AudioMixer::start(const SOUNDS sound) {
+  uint8_t v = 0;
+  while (v < AUDIO_VOICES && voices[v].sound != nullptr) {
+    v++;
+  }
+  if (v == AUDIO_VOICES) {
+    v = next_voice;
+  }
+  next_voice = (v + 1) % AUDIO_VOICES;
+
+  audio_voice_t& voice = voices[v];
+  voice.sound = &SOUNDS_ARRAY[sound];
+  voice.note = 0;
+  voice.phase = 0;
+  if (voice.sound->clip != nullptr) {
+    voice.remaining = voice.sound->clip_length;
+  } else {
+    startNote(voice);
+  }
+}
+
+// Frees the voice after the last note
+void AudioMixer::startNote(audio_voice_t& voice) {
+  if (voice.note >= SOUND_MAX_NOTES || voice.sound->notes[voice.note].duration_ms == 0) {
+    voice.sound = nullptr;
+    return;
+  }
+  const sound_note_t& note = voice.sound->notes[voice.note];
+  voice.remaining = note.duration_ms * AUDIO_SAMPLE_RATE / 1000;
+  voice.step = ((uint64_t)note.frequency << 32) / AUDIO_SAMPLE_RATE;
+}
+
+void AudioMixer::mixVoice(audio_voice_t& voice, uint16_t* samples, const uint count) {
+  const sound_t& sound = *voice.sound;
+  uint i = 0;
+  while (i < count && voice.sound != nullptr) {
+    const uint run = voice.remaining < count - i ? voice.remaining : count - i;
+    if (sound.clip != nullptr) {
+      const uint8_t* clip = sound.clip + (sound.clip_length - voice.remaining);
+      for (uint s = 0; s < run; s++) {
+        samples[i + s] += (clip[s] * sound.volume) >> 8;
+      }
+    } else if (voice.step != 0) { // not a rest
+      for (uint s = 0; s < run; s++) {
+        samples[i + s] += voice.phase >> 31 ? 0 : sound.volume;
+        voice.phase += voice.step;
+      }
+    }
+    i += run;
+    voice.remaining -= run;
+
+    if (voice.remaining == 0) {
+      if (sound.clip != nullptr) {
+        voice.sound = nullptr;
+      } else {
+        voice.note++;
+        startNote(voice);
+      }
+    }
+  }
+}
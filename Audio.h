@@ -0,0 +1,57 @@
+#ifndef AUDIO_H
+#define AUDIO_H
+
+#include "Hal.h"
+#include "Sounds.h"
+#include "RingBuffer.h"
+
+#define AUDIO_PIN 21 // buzzer A of the BitDogLab, buzzer B is on GPIO 10
+#define AUDIO_VOICES 4 // sounds mixed at once
+#define AUDIO_QUEUE_SIZE 8 // power of two, sounds started between two buffers
+
+struct audio_voice_t {
+  const sound_t* sound; // nullptr when the voice is free
+  uint8_t note;
+  uint32_t remaining; // samples left of the note or the clip
+  uint32_t phase; // square wave, the top bit is the output
+  uint32_t step; // phase per sample
+};
+
+// Voices and the queue of sounds they start, mixed into buffers of samples.
+// play() and mix() may run in different contexts, each from one only.
+class AudioMixer {
+public:
+  AudioMixer();
+
+  bool play(const SOUNDS sound);
+  void mix(uint16_t* samples, const uint count);
+private:
+  void start(const SOUNDS sound);
+  void startNote(audio_voice_t& voice);
+  void mixVoice(audio_voice_t& voice, uint16_t* samples, const uint count);
+
+  RingBuffer<uint8_t, AUDIO_QUEUE_SIZE> queue;
+  audio_voice_t voices[AUDIO_VOICES];
+  uint8_t next_voice; // taken over when none is free, in turn
+};
+
+// Sound effects out of the buzzer. play() only queues the sound, the mixer
+// picks it up from the DMA interrupt (hal_audio_init()) when it fills the next
+// buffer, so starting a sound costs the game a push and never waits. Voices
+// add up, clipped to the top level.
+class Audio {
+public:
+  static Audio& getInstance();
+
+  bool play(const SOUNDS sound);
+private:
+  Audio();
+
+  static void fill(uint16_t* samples, uint count);
+
+  AudioMixer mixer;
+
+  static Audio* instance; // for fill(), set before the first buffer is asked for
+};
+
+#endif // AUDIO_H
@@ -0,0 +1,295 @@
+// Microbenchmarks of the hot paths, one CSV line per case:
+//   name,iterations,ns_per_iteration,cycles_per_iteration,total_us
+// On the host every iteration is timed with the wall clock (cycles are 0). On
+// the board SysTick counts the cycles of every iteration and the RP2040 timer
+// the whole case, results go out over USB once a terminal is connected and
+// again on every byte received. tools/bench_compare.py checks a run against a
+// stored baseline.
+#include <stdio.h>
+#include "Hal.h"
+#include "GPIO.h"
+#include "InputManager.h"
+#include "LedMatrix.h"
+#include "Scoring.h"
+#include "Game.h"
+#include "Audio.h"
+#include "Oled.h"
+
+#if HAL_HOST
+#include <chrono>
+#else
+#include "pico/stdlib.h"
+#include "pico/stdio_usb.h"
+#include "hardware/clocks.h"
+#include "hardware/structs/systick.h"
+#endif
+
+#ifndef BENCH_ITERATIONS
+#define BENCH_ITERATIONS 1000
+#endif
+#define BENCH_REPEATS 5 // the fastest repeat is reported, the others caught noise
+#define BENCH_LED_WAIT_US 100000 // longest a frame may take to latch
+
+typedef void (*bench_callback_t)(uint32_t iteration);
+
+struct bench_case_t {
+  const char* name;
+  bench_callback_t prepare; // untimed, may be nullptr
+  bench_callback_t run;
+};
+
+static volatile uint32_t bench_sink; // keeps results the compiler could drop
+static frame_t bench_frames[2];
+static double bench_overhead; // ticks of timing an empty case, taken off every case
+
+#if HAL_HOST
+static uint64_t bench_stamp() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::steady_clock::now().time_since_epoch()
+  ).count();
+}
+
+// ns between two stamps
+static uint64_t bench_ticks(uint64_t start, uint64_t end) {
+  return end - start;
+}
+#else
+static uint64_t bench_stamp() {
+  return systick_hw->cvr;
+}
+
+// cycles between two stamps, SysTick counts down from 2^24 - 1
+static uint64_t bench_ticks(uint64_t start, uint64_t end) {
+  return (start - end) & 0xFFFFFF;
+}
+#endif
+
+static void wait_render_done(uint32_t iteration) {
+  (void)iteration;
+  led_matrix_t& led_matrix = led_matrix_t::getInstance();
+  uint64_t deadline = hal_time_us() + BENCH_LED_WAIT_US;
+  while (!led_matrix.isRenderDone() && hal_time_us() < deadline) {
+    hal_sleep_until_us(hal_time_us() + 100);
+  }
+}
+
+static void prepare_render_changed(uint32_t iteration) {
+  wait_render_done(iteration);
+  led_matrix_t::getInstance().setLEDs(bench_frames[iteration % 2]);
+}
+
+static void run_render(uint32_t iteration) {
+  (void)iteration;
+  led_matrix_t::getInstance().render();
+}
+
+static void run_set_leds(uint32_t iteration) {
+  led_matrix_t::getInstance().setLEDs(bench_frames[iteration % 2]);
+}
+
+static void run_clear(uint32_t iteration) {
+  (void)iteration;
+  led_matrix_t::getInstance().clear();
+}
+
+static void run_draw_glyph(uint32_t iteration) {
+  led_matrix_t::getInstance().setNumber(iteration % 10, BLUE);
+}
+
+static void run_draw_text(uint32_t iteration) {
+  led_matrix_t::getInstance().drawText("MEMORY 32", iteration, BLUE);
+}
+
+static void run_frame_compare(uint32_t iteration) {
+  bench_sink = bench_frames[0] == bench_frames[iteration % 2];
+}
+
+static void run_score_session(uint32_t iteration) {
+  (void)iteration;
+  score_session(frames_framer, frames_memorizer, MAX_FRAMES, frame_scores, &session_score);
+  bench_sink = session_score.total;
+}
+
+static void run_edit_click(uint32_t iteration) {
+  dispatch_event({EVENT_CLICK, (uint8_t)(iteration % 2 ? BTN_A_PIN : BTN_B_PIN), NEUTRAL, 0});
+  redraw_state();
+}
+
+static void run_edit_joystick(uint32_t iteration) {
+  dispatch_event({EVENT_JOYSTICK, JST_X_PIN, iteration % 2 ? NEG : POS, 0});
+  redraw_state();
+}
+
+static void run_idle_tick(uint32_t iteration) {
+  (void)iteration;
+  update_state(0);
+}
+
+static void run_input_update(uint32_t iteration) {
+  (void)iteration;
+  InputManager::getInstance().update();
+}
+
+static void run_input_sample(uint32_t iteration) {
+  (void)iteration;
+  InputManager::getInstance().sample();
+}
+
+// A mixer of its own: the one of Audio is mixed from the DMA interrupt
+static AudioMixer bench_mixer;
+
+static void prepare_audio_mix(uint32_t iteration) {
+  // every voice busy, a sound started now and then
+  if (iteration % 64 == 0) {
+    for (uint8_t v = 0; v < AUDIO_VOICES; v++) {
+      bench_mixer.play((SOUNDS)((iteration / 64 + v) % SOUNDS_COUNT));
+    }
+  }
+}
+
+static void run_audio_mix(uint32_t iteration) {
+  (void)iteration;
+  static uint16_t samples[HAL_AUDIO_BUFFER];
+  bench_mixer.mix(samples, HAL_AUDIO_BUFFER);
+  bench_sink = samples[0];
+}
+
+// A digit changes every time, as when paging through frames
+static void run_oled_line(uint32_t iteration) {
+  Oled::getInstance().drawLine(1, iteration % 2 ? "FRAME 1 OF 32" : "FRAME 2 OF 32");
+}
+
+static void run_empty(uint32_t iteration) {
+  bench_sink = iteration;
+}
+
+static const bench_case_t BENCH_CASES[] = {
+  {"render_changed", prepare_render_changed, run_render},
+  {"render_unchanged", wait_render_done, run_render},
+  {"set_leds", nullptr, run_set_leds},
+  {"clear", nullptr, run_clear},
+  {"draw_glyph", nullptr, run_draw_glyph},
+  {"draw_text", nullptr, run_draw_text},
+  {"frame_compare", nullptr, run_frame_compare},
+  {"score_session", nullptr, run_score_session},
+  {"edit_click", nullptr, run_edit_click},
+  {"edit_joystick", nullptr, run_edit_joystick},
+  {"idle_tick", nullptr, run_idle_tick},
+  {"input_update", nullptr, run_input_update},
+  {"input_sample", nullptr, run_input_sample},
+  {"audio_mix", prepare_audio_mix, run_audio_mix},
+  {"oled_line", nullptr, run_oled_line},
+};
+
+// Ticks per iteration. Cases with a prepare step are timed one iteration at
+// a time, less the cost of reading the clock.
+static double time_case(const bench_case_t& bench) {
+#if HAL_HOST
+  if (bench.prepare == nullptr) {
+    // the host clock costs more than most cases, time the whole batch
+    uint64_t start = bench_stamp();
+    for (uint32_t i = 0; i < BENCH_ITERATIONS; i++) {
+      bench.run(i);
+    }
+    return (double)bench_ticks(start, bench_stamp()) / BENCH_ITERATIONS;
+  }
+#endif
+  uint64_t ticks = 0;
+  for (uint32_t i = 0; i < BENCH_ITERATIONS; i++) {
+    if (bench.prepare != nullptr) {
+      bench.prepare(i);
+    }
+    uint64_t start = bench_stamp();
+    bench.run(i);
+    ticks += bench_ticks(start, bench_stamp());
+  }
+  double per_iteration = (double)ticks / BENCH_ITERATIONS - bench_overhead;
+  return per_iteration > 0 ? per_iteration : 0;
+}
+
+static void run_case(const bench_case_t& bench) {
+  uint64_t start_us = hal_time_us();
+#if HAL_HOST
+  uint64_t wall_start = bench_stamp();
+#endif
+  double ticks = time_case(bench);
+  for (uint8_t r = 1; r < BENCH_REPEATS; r++) {
+    double repeat = time_case(bench);
+    ticks = repeat < ticks ? repeat : ticks;
+  }
+
+#if HAL_HOST
+  // the host clock is virtual, hal_time_us() only moves while waiting on LEDs
+  (void)start_us;
+  uint64_t total_us = (bench_stamp() - wall_start) / 1000;
+  double ns = ticks;
+  double cycles = 0;
+#else
+  uint64_t total_us = hal_time_us() - start_us;
+  double cycles = ticks;
+  double ns = cycles * 1e9 / clock_get_hz(clk_sys);
+#endif
+  printf("%s,%d,%.3f,%.1f,%llu\n", bench.name, BENCH_ITERATIONS, ns, cycles, (unsigned long long)total_us);
+}
+
+static void run_all() {
+  // an empty case with a prepare step, so it is timed like the real ones
+  const bench_case_t empty = {"empty", run_empty, run_empty};
+  bench_overhead = 0;
+  for (uint8_t r = 0; r < BENCH_REPEATS; r++) {
+    double repeat = time_case(empty);
+    bench_overhead = r == 0 || repeat < bench_overhead ? repeat : bench_overhead;
+  }
+
+  printf("name,iterations,ns_per_iteration,cycles_per_iteration,total_us\n");
+  for (const bench_case_t& bench : BENCH_CASES) {
+    run_case(bench);
+  }
+  fflush(stdout);
+}
+
+int main() {
+  hal_init();
+  gpio_init_all();
+#if HAL_HOST
+  hal_host_benchmark_mode();
+#else
+  // processor clock, full 24-bit reload
+  systick_hw->rvr = 0xFFFFFF;
+  systick_hw->cvr = 0;
+  systick_hw->csr = 0x5;
+#endif
+
+  led_matrix_t::getInstance();
+  InputManager::getInstance();
+  Audio::getInstance();
+
+  // a game's worth of frames, with a few mistakes to score, edited by the player
+  bench_frames[1].set(LED_COUNT_X - 1, LED_COUNT_Y - 1, RED);
+  frames_to_remember = MAX_FRAMES;
+  change_state(MEMORIZER_STATE);
+  for (uint8_t i = 0; i < MAX_FRAMES; i++) {
+    for (uint32_t p = 0; p < LED_COUNT; p++) {
+      frames_framer[i].set(p % LED_COUNT_X, p / LED_COUNT_X, (COLORS)((p + i) % COLORS_COUNT));
+    }
+    frames_memorizer[i] = frames_framer[i];
+    if (i % 2 == 1) {
+      frames_memorizer[i].set(i % LED_COUNT_X, 0, BLACK);
+    }
+  }
+
+#if HAL_HOST
+  run_all();
+#else
+  while (true) {
+    while (!stdio_usb_connected()) {
+      sleep_ms(100);
+    }
+    run_all();
+    while (getchar_timeout_us(1000000) == PICO_ERROR_TIMEOUT) {
+      tight_loop_contents();
+    }
+  }
+#endif
+  return 0;
+}
@@ -0,0 +1,279 @@
+#include "Command.h"
+#include "Hal.h"
+#include "GPIO.h"
+#include "InputManager.h"
+#include "InputLog.h"
+#include "LedMatrix.h"
+
+#include <string.h>
+
+static_assert(COMMAND_MAX_PAYLOAD <= UINT16_MAX, "the length field is 16 bits");
+static_assert(COMMAND_MAX_INPUTS <= INJECTED_QUEUE_SIZE, "a COMMAND_INPUT fits in the queue");
+
+// CRC-16/CCITT-FALSE: polynomial 0x1021, from 0xFFFF, no reflection
+static uint16_t crc16(uint16_t crc, const uint8_t byte) {
+  crc ^= byte << 8;
+  for (uint8_t bit = 0; bit < 8; bit++) {
+    crc = crc & 0x8000 ? (crc << 1) ^ 0x1021 : crc << 1;
+  }
+  return crc;
+}
+
+Command::Command() :
+  parse_state(PARSE_SYNC),
+  last_byte_time(0),
+  type(0),
+  length(0),
+  received(0),
+  crc(0),
+  message_crc(0),
+  commands(0),
+  errors(0) {}
+
+Command& Command::getInstance() {
+  static Command instance;
+  return instance;
+}
+
+// Returns false for a byte that isn't part of a message, left to the caller
+bool Command::receive(const uint8_t byte) {
+  const uint64_t now = hal_time_us();
+  if (parse_state != PARSE_SYNC && now - last_byte_time > COMMAND_TIMEOUT_MS * 1000) {
+    parse_state = PARSE_SYNC; // the rest is never coming
+  }
+  last_byte_time = now;
+  if (parse_state != PARSE_SYNC && parse_state < PARSE_CRC_LOW) {
+    crc = crc16(crc, byte);
+  }
+
+  switch (parse_state) {
+  case PARSE_SYNC:
+    if (byte != COMMAND_SYNC) {
+      return false;
+    }
+    crc = 0xFFFF;
+    parse_state = PARSE_TYPE;
+    break;
+  case PARSE_TYPE:
+    type = byte;
+    parse_state = PARSE_LENGTH_LOW;
+    break;
+  case PARSE_LENGTH_LOW:
+    length = byte;
+    parse_state = PARSE_LENGTH_HIGH;
+    break;
+  case PARSE_LENGTH_HIGH:
+    length |= byte << 8;
+    received = 0;
+    if (length > COMMAND_MAX_PAYLOAD) {
+      // skipped, not read as console keys
+      error(type, COMMAND_BAD_LENGTH);
+      parse_state = PARSE_SKIP;
+    } else {
+      parse_state = length > 0 ? PARSE_PAYLOAD : PARSE_CRC_LOW;
+    }
+    break;
+  case PARSE_PAYLOAD:
+    payload[received++] = byte;
+    if (received == length) {
+      parse_state = PARSE_CRC_LOW;
+    }
+    break;
+  case PARSE_CRC_LOW:
+    message_crc = byte;
+    parse_state = PARSE_CRC_HIGH;
+    break;
+  case PARSE_CRC_HIGH:
+    message_crc |= byte << 8;
+    parse_state = PARSE_SYNC;
+    if (message_crc != crc) {
+      error(0, COMMAND_BAD_CRC);
+    } else {
+      run();
+    }
+    break;
+  case PARSE_SKIP:
+    if (++received == length + 2) {
+      parse_state = PARSE_SYNC;
+    }
+    break;
+  }
+  return true;
+}
+
+void Command::run() {
+  commands++;
+  switch (type) {
+  case COMMAND_HELLO: {
+    if (length != 0) {
+      error(type, COMMAND_BAD_LENGTH);
+      return;
+    }
+    const command_hello_t hello = {
+      COMMAND_VERSION, LED_COUNT_X, LED_COUNT_Y, FRAME_PLANES, MAX_FRAMES, sizeof(frame_t)
+    };
+    reply(type, (const uint8_t*)&hello, sizeof(hello));
+    break;
+  }
+  case COMMAND_READ_FRAMES:
+    readFrames();
+    break;
+  case COMMAND_WRITE_FRAMES:
+    writeFrames();
+    break;
+  case COMMAND_INPUT:
+    input();
+    break;
+  case COMMAND_STATE:
+    state();
+    break;
+  case COMMAND_COUNTERS: {
+    if (length != 0) {
+      error(type, COMMAND_BAD_LENGTH);
+      return;
+    }
+    led_matrix_t& led_matrix = led_matrix_t::getInstance();
+    const command_counters_t counters = {
+      (uint32_t)(hal_time_us() / 1000),
+      InputManager::getInstance().getTick(),
+      led_matrix.getFramesIssued(),
+      led_matrix.getFramesSkipped(),
+      current_state,
+      frames_to_remember,
+      session_score.perfect_frames,
+      session_score.accuracy,
+      session_score.total,
+      commands,
+      errors
+    };
+    reply(type, (const uint8_t*)&counters, sizeof(counters));
+    break;
+  }
+  default:
+    error(type, COMMAND_BAD_TYPE);
+    break;
+  }
+}
+
+// Frames first to first + count of a set, all in one answer
+void Command::readFrames() {
+  if (length != COMMAND_FRAMES_HEADER) {
+    error(type, COMMAND_BAD_LENGTH);
+    return;
+  }
+  const uint8_t set = payload[0], first = payload[1], count = payload[2];
+  // a puzzle in flash is only as long as it is
+  const uint8_t limit = set == COMMAND_FRAMES_SOLUTION ? frames_to_remember : MAX_FRAMES;
+  if (set >= COMMAND_FRAME_SETS || first + count > limit) {
+    error(type, COMMAND_BAD_ARGUMENT);
+    return;
+  }
+  const frame_t* frames =
+    set == COMMAND_FRAMES_FRAMER ? frames_framer :
+    set == COMMAND_FRAMES_MEMORIZER ? frames_memorizer : frames_solution;
+  memcpy(payload + COMMAND_FRAMES_HEADER, &frames[first], count * sizeof(frame_t));
+  reply(type, payload, COMMAND_FRAMES_HEADER + count * sizeof(frame_t));
+}
+
+// Frames the game isn't looking at are left as they are. The state on the
+// LEDs is drawn again, it may show one of them.
+void Command::writeFrames() {
+  if (length < COMMAND_FRAMES_HEADER) {
+    error(type, COMMAND_BAD_LENGTH);
+    return;
+  }
+  const uint8_t set = payload[0], first = payload[1], count = payload[2];
+  if (length != COMMAND_FRAMES_HEADER + count * sizeof(frame_t)) {
+    error(type, COMMAND_BAD_LENGTH);
+    return;
+  }
+  if (set > COMMAND_FRAMES_MEMORIZER || first + count > MAX_FRAMES) {
+    error(type, COMMAND_BAD_ARGUMENT);
+    return;
+  }
+  // the log only holds input, a replay wouldn't have these frames
+  if (InputLog::getInstance().getMode() != INPUT_LOG_OFF) {
+    error(type, COMMAND_BUSY);
+    return;
+  }
+  frame_t* frames = set == COMMAND_FRAMES_FRAMER ? frames_framer : frames_memorizer;
+  memcpy(&frames[first], payload + COMMAND_FRAMES_HEADER, count * sizeof(frame_t));
+  for (uint8_t i = 0; i < count; i++) {
+    frames[first + i].trim(); // stray padding would score a right frame as wrong
+  }
+  redraw_state();
+  reply(type, nullptr, 0);
+}
+
+// Taken by the next logic tick, and recorded like any other input
+void Command::input() {
+  const uint8_t count = length / 2;
+  if (length % 2 != 0 || count > COMMAND_MAX_INPUTS) {
+    error(type, COMMAND_BAD_LENGTH);
+    return;
+  }
+  for (uint8_t i = 0; i < count; i++) {
+    const uint8_t pin = payload[i * 2], value = payload[i * 2 + 1];
+    const bool joystick = pin == JST_X_PIN || pin == JST_Y_PIN;
+    const bool button = pin == BTN_A_PIN || pin == BTN_B_PIN || pin == SW_PIN;
+    if ((!joystick && !button) || (joystick && value > NEUTRAL) || (button && value > 1)) {
+      error(type, COMMAND_BAD_ARGUMENT);
+      return;
+    }
+  }
+  InputManager& input_manager = InputManager::getInstance();
+  if (InputLog::getInstance().getMode() == INPUT_LOG_REPLAY || input_manager.getInjectRoom() < count) {
+    error(type, COMMAND_BUSY);
+    return;
+  }
+  for (uint8_t i = 0; i < count; i++) {
+    input_manager.inject(payload[i * 2], payload[i * 2 + 1]);
+  }
+  reply(type, nullptr, 0);
+}
+
+void Command::state() {
+  if (length != 2) {
+    error(type, COMMAND_BAD_LENGTH);
+    return;
+  }
+  const uint8_t target = payload[0], frames = payload[1];
+  if (target >= STATES_COUNT || (frames != 0 && (frames < MIN_FRAMES || frames > MAX_FRAMES))) {
+    error(type, COMMAND_BAD_ARGUMENT);
+    return;
+  }
+  // nor this jump
+  if (InputLog::getInstance().getMode() != INPUT_LOG_OFF) {
+    error(type, COMMAND_BUSY);
+    return;
+  }
+  force_state((state_t)target, frames);
+  reply(type, nullptr, 0);
+}
+
+void Command::reply(const uint8_t reply_type, const uint8_t* data, const uint16_t data_length) {
+  const uint8_t header[] = {
+    COMMAND_SYNC, (uint8_t)(reply_type == COMMAND_ERROR ? reply_type : reply_type | COMMAND_REPLY),
+    (uint8_t)(data_length & 0xFF), (uint8_t)(data_length >> 8)
+  };
+  uint16_t reply_crc = 0xFFFF;
+  for (uint8_t i = 1; i < sizeof(header); i++) {
+    reply_crc = crc16(reply_crc, header[i]);
+  }
+  for (uint16_t i = 0; i < data_length; i++) {
+    reply_crc = crc16(reply_crc, data[i]);
+  }
+  const uint8_t footer[] = {(uint8_t)(reply_crc & 0xFF), (uint8_t)(reply_crc >> 8)};
+
+  hal_stdio_write(header, sizeof(header));
+  if (data_length > 0) {
+    hal_stdio_write(data, data_length);
+  }
+  hal_stdio_write(footer, sizeof(footer));
+}
+
+void Command::error(const uint8_t command_type, const command_error_t code) {
+  errors++;
+  const uint8_t data[] = {command_type, (uint8_t)code};
+  reply(COMMAND_ERROR, data, sizeof(data));
+}
@@ -0,0 +1,110 @@
+#ifndef COMMAND_H
+#define COMMAND_H
+
+#include "Game.h"
+
+// Binary commands from a PC over stdio (USB CDC), for loading frames and
+// driving the game without touching the board; tools/command.py sends them.
+// Both ways a message is
+//   COMMAND_SYNC, type, payload length (16 bits), payload, CRC
+// little endian, the CRC-16/CCITT-FALSE of everything after the sync byte.
+// The board answers every command with the type | COMMAND_REPLY, or with
+// COMMAND_ERROR, in between trace records. receive() takes the bytes one at a
+// time as they come, so a message may arrive over any number of console
+// ticks; bytes outside a message are the console keys of Memory_game.cpp.
+#define COMMAND_SYNC 0xC5 // not a console key, not TRACE_SYNC
+#define COMMAND_VERSION 1
+#define COMMAND_REPLY 0x80
+#define COMMAND_TIMEOUT_MS 500 // a message cut short is dropped after this
+#define COMMAND_FRAMES_HEADER 3 // set, first frame, frame count
+#define COMMAND_MAX_PAYLOAD (COMMAND_FRAMES_HEADER + MAX_FRAMES * sizeof(frame_t))
+#define COMMAND_MAX_INPUTS 16 // pin and value pairs in one COMMAND_INPUT
+
+enum command_type_t {
+  COMMAND_HELLO = 1,    // -> command_hello_t
+  COMMAND_READ_FRAMES,  // set, first, count -> set, first, count, frame_t bitplanes
+  COMMAND_WRITE_FRAMES, // set, first, count, frame_t bitplanes -> (not while the input log is on)
+  COMMAND_INPUT,        // pin, value (pressed, or direction_t for the joystick) pairs ->
+  COMMAND_STATE,        // state_t, frames to remember (0 keeps them) -> (not while the input log is on)
+  COMMAND_COUNTERS,     // -> command_counters_t
+  COMMAND_ERROR = 0x7F  // reply only: type of the command, command_error_t
+};
+
+enum command_error_t {
+  COMMAND_BAD_CRC,      // type 0, the type can't be trusted
+  COMMAND_BAD_TYPE,
+  COMMAND_BAD_LENGTH,
+  COMMAND_BAD_ARGUMENT,
+  COMMAND_BUSY,         // replaying, the log owns the game, or recording what the log can't hold
+};
+
+enum command_frames_t {
+  COMMAND_FRAMES_FRAMER,    // frames_framer
+  COMMAND_FRAMES_MEMORIZER, // frames_memorizer
+  COMMAND_FRAMES_SOLUTION,  // frames_solution, read only and frames_to_remember long
+  COMMAND_FRAME_SETS
+};
+
+struct __attribute__((packed)) command_hello_t {
+  uint8_t version;
+  uint8_t width;
+  uint8_t height;
+  uint8_t planes;
+  uint8_t max_frames;
+  uint16_t frame_size; // bytes of one frame_t
+};
+
+struct __attribute__((packed)) command_counters_t {
+  uint32_t time_ms;
+  uint32_t ticks; // logic ticks since the game or the recording started
+  uint32_t frames_issued; // LED frames
+  uint32_t frames_skipped;
+  uint8_t state;
+  uint8_t frames_to_remember;
+  uint8_t perfect_frames; // of the last scored game
+  uint8_t accuracy;
+  uint32_t score;
+  uint16_t commands; // run
+  uint16_t errors; // answered with COMMAND_ERROR
+};
+
+class Command {
+public:
+  static Command& getInstance();
+
+  bool receive(const uint8_t byte);
+private:
+  Command();
+
+  enum parse_state_t {
+    PARSE_SYNC,
+    PARSE_TYPE,
+    PARSE_LENGTH_LOW,
+    PARSE_LENGTH_HIGH,
+    PARSE_PAYLOAD,
+    PARSE_CRC_LOW,
+    PARSE_CRC_HIGH,
+    PARSE_SKIP // payload too long to keep, and its CRC
+  };
+
+  void run();
+  void readFrames();
+  void writeFrames();
+  void input();
+  void state();
+  void reply(const uint8_t reply_type, const uint8_t* data, const uint16_t data_length);
+  void error(const uint8_t command_type, const command_error_t code);
+
+  parse_state_t parse_state;
+  uint64_t last_byte_time; // us
+  uint8_t type;
+  uint16_t length;
+  uint16_t received; // payload bytes, or bytes skipped
+  uint16_t crc; // of the message so far
+  uint16_t message_crc;
+  uint8_t payload[COMMAND_MAX_PAYLOAD];
+  uint16_t commands;
+  uint16_t errors;
+};
+
+#endif // COMMAND_H
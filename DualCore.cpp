@@ -0,0 +1,58 @@
+#include "DualCore.h"
+
+#if DUAL_CORE_MODE
+
+#include "pico/stdlib.h"
+#include "pico/multicore.h"
+#include "pico/flash.h"
+#include "InputManager.h"
+#include "LedMatrix.h"
+
+static void core1_main() {
+  // constructed here so their GPIO and DMA interrupts are taken by core 1
+  InputManager& input_manager = InputManager::getInstance();
+  led_matrix_t& led_matrix = led_matrix_t::getInstance();
+  // lets core 0 park this core while it writes the flash store
+  flash_safe_execute_core_init();
+  multicore_fifo_push_blocking(CORE1_READY);
+
+  uint64_t next_sample = hal_time_us();
+  while (true) {
+    if (hal_time_us() >= next_sample) {
+      // the GPIO interrupt also feeds the input queues, keep it out while sampling
+      uint32_t irq_state = hal_irq_save();
+      input_manager.sample();
+      hal_irq_restore(irq_state);
+      next_sample += INPUT_SAMPLE_PERIOD_US;
+    }
+
+    while (multicore_fifo_rvalid()) {
+      multicore_fifo_pop_blocking(); // doorbell only, the frame itself is in the queue
+    }
+    led_matrix.service();
+
+    // woken early by the doorbell (the FIFO push raises an event)
+    best_effort_wfe_or_timeout(from_us_since_boot(next_sample));
+  }
+}
+
+void dual_core_doorbell() {
+  if (multicore_fifo_wready()) {
+    multicore_fifo_push_blocking(CORE1_DOORBELL_FRAME);
+  }
+}
+
+void dual_core_launch() {
+  multicore_launch_core1(core1_main);
+  while (multicore_fifo_pop_blocking() != CORE1_READY) {
+    tight_loop_contents();
+  }
+}
+
+#else
+
+void dual_core_launch() {}
+
+void dual_core_doorbell() {}
+
+#endif
@@ -0,0 +1,20 @@
+#ifndef DUAL_CORE_H
+#define DUAL_CORE_H
+
+#include "Hal.h"
+
+// Opt-in (MEMORY_GAME_DUAL_CORE in CMake): input sampling and LED output run
+// on core 1, the game state machine stays on core 0. The cores only share the
+// InputManager event queues and the LedMatrix frame queue, the SIO FIFO is
+// used as a doorbell so core 1 can sleep between samples.
+#ifndef DUAL_CORE_MODE
+#define DUAL_CORE_MODE 0
+#endif
+
+#define CORE1_READY 0xC0DE0001
+#define CORE1_DOORBELL_FRAME 0xC0DE0002
+
+void dual_core_launch();
+void dual_core_doorbell();
+
+#endif // DUAL_CORE_H
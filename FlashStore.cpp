@@ -0,0 +1,228 @@
+#include "FlashStore.h"
+#include "Trace.h"
+
+#include <string.h>
+
+static_assert(HAL_FLASH_STORE_SECTORS >= 2, "the log needs a sector to move on to");
+static_assert(HAL_FLASH_STORE_SECTORS <= 32, "erase_pending has one bit per sector");
+
+FlashStore::FlashStore() :
+  sector_states(), sector_sequences(), erase_pending(0), active_sector(-1),
+  write_offset(HAL_FLASH_SECTOR_SIZE), sequence(0), values(), lengths(), page_buffer() {
+  scan();
+}
+
+FlashStore& FlashStore::getInstance() {
+  static FlashStore instance;
+  return instance;
+}
+
+void FlashStore::scan() {
+  const uint8_t* flash = hal_flash_store_data();
+  for (uint8_t s = 0; s < HAL_FLASH_STORE_SECTORS; s++) {
+    store_sector_header_t header;
+    memcpy(&header, flash + s * HAL_FLASH_SECTOR_SIZE, sizeof(header));
+    if (header.magic == FLASH_STORE_MAGIC) {
+      sector_states[s] = SECTOR_USED;
+      sector_sequences[s] = header.sequence;
+    } else if (isSectorErased(s)) {
+      sector_states[s] = SECTOR_ERASED;
+    } else {
+      sector_states[s] = SECTOR_DIRTY;
+      erase_pending |= 1u << s;
+    }
+  }
+
+  // oldest sector first, so newer records win
+  uint32_t replayed = 0;
+  while (true) {
+    int8_t oldest = -1;
+    for (uint8_t s = 0; s < HAL_FLASH_STORE_SECTORS; s++) {
+      if (
+        sector_states[s] == SECTOR_USED && !(replayed & (1u << s)) &&
+        (oldest < 0 || sector_sequences[s] < sector_sequences[oldest])
+      ) {
+        oldest = s;
+      }
+    }
+    if (oldest < 0) {
+      break;
+    }
+    replayed |= 1u << oldest;
+    write_offset = replaySector(oldest);
+    active_sector = oldest;
+    sequence = sector_sequences[oldest];
+  }
+
+  // get the sector the log moves to next ready ahead of time
+  if (active_sector >= 0) {
+    uint8_t next = (active_sector + 1) % HAL_FLASH_STORE_SECTORS;
+    if (sector_states[next] != SECTOR_ERASED) {
+      erase_pending |= 1u << next;
+    }
+  }
+}
+
+// Returns where the log of the sector ends
+uint32_t FlashStore::replaySector(const uint8_t sector) {
+  const uint8_t* base = hal_flash_store_data() + sector * HAL_FLASH_SECTOR_SIZE;
+  uint32_t offset = sizeof(store_sector_header_t);
+
+  while (offset + sizeof(store_record_header_t) <= HAL_FLASH_SECTOR_SIZE) {
+    store_record_header_t header;
+    memcpy(&header, base + offset, sizeof(header));
+    if (header.type == STORE_RECORD_FREE) {
+      return offset;
+    }
+
+    const uint8_t* payload = base + offset + sizeof(header);
+    uint32_t size = sizeof(header) + ((header.length + 3) & ~3u);
+    if (
+      header.length > FLASH_STORE_RECORD_MAX ||
+      offset + size > HAL_FLASH_SECTOR_SIZE ||
+      header.check != check(header.type, header.length, payload)
+    ) {
+      // torn by a power cut, nothing more can be appended to this sector
+      return HAL_FLASH_SECTOR_SIZE;
+    }
+
+    // unknown types are skipped, so older firmware can read a newer log
+    if (header.type < STORE_RECORD_TYPES) {
+      memcpy(values[header.type], payload, header.length);
+      lengths[header.type] = header.length;
+    }
+    offset += size;
+  }
+  return offset;
+}
+
+bool FlashStore::isSectorErased(const uint8_t sector) {
+  const uint8_t* base = hal_flash_store_data() + sector * HAL_FLASH_SECTOR_SIZE;
+  for (uint32_t i = 0; i < HAL_FLASH_SECTOR_SIZE; i++) {
+    if (base[i] != 0xFF) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool FlashStore::read(const store_record_type_t type, void* payload, const uint8_t length) {
+  if (type >= STORE_RECORD_TYPES || lengths[type] == 0) {
+    return false;
+  }
+  // fields a shorter, older record doesn't have read as 0
+  uint8_t stored = lengths[type] < length ? lengths[type] : length;
+  memset(payload, 0, length);
+  memcpy(payload, values[type], stored);
+  return true;
+}
+
+bool FlashStore::write(const store_record_type_t type, const void* payload, const uint8_t length) {
+  if (type >= STORE_RECORD_TYPES || length == 0 || length > FLASH_STORE_RECORD_MAX) {
+    return false;
+  }
+  if (lengths[type] == length && memcmp(values[type], payload, length) == 0) {
+    return true; // unchanged, spare the flash
+  }
+
+  append(type, payload, length);
+  memcpy(values[type], payload, length);
+  lengths[type] = length;
+  return true;
+}
+
+void FlashStore::append(const uint8_t type, const void* payload, const uint8_t length) {
+  uint8_t record[sizeof(store_record_header_t) + FLASH_STORE_RECORD_MAX];
+  uint32_t size = sizeof(store_record_header_t) + ((length + 3) & ~3u);
+  if (write_offset + size > HAL_FLASH_SECTOR_SIZE) {
+    rotate();
+  }
+
+  store_record_header_t header = {type, length, check(type, length, (const uint8_t*)payload)};
+  memset(record, 0, sizeof(record));
+  memcpy(record, &header, sizeof(header));
+  memcpy(record + sizeof(header), payload, length);
+
+  program(active_sector * HAL_FLASH_SECTOR_SIZE + write_offset, record, size);
+  write_offset += size;
+}
+
+void FlashStore::rotate() {
+  uint8_t next = active_sector < 0 ? 0 : (active_sector + 1) % HAL_FLASH_STORE_SECTORS;
+  if (sector_states[next] != SECTOR_ERASED) {
+    erase(next); // service() didn't get to it, this write stalls
+  }
+  active_sector = next;
+  write_offset = sizeof(store_sector_header_t);
+
+  // snapshot first and header last: a sector without a header is never replayed
+  for (uint8_t type = 0; type < STORE_RECORD_TYPES; type++) {
+    if (lengths[type] > 0) {
+      append(type, values[type], lengths[type]);
+    }
+  }
+  sequence++;
+  store_sector_header_t header = {FLASH_STORE_MAGIC, sequence};
+  program(next * HAL_FLASH_SECTOR_SIZE, (const uint8_t*)&header, sizeof(header));
+  sector_states[next] = SECTOR_USED;
+  sector_sequences[next] = sequence;
+  TRACE_INFO(TRACE_STORE_ROTATE, next, sequence);
+
+  // the oldest sector only holds values the snapshot has now
+  uint8_t oldest = (next + 1) % HAL_FLASH_STORE_SECTORS;
+  if (sector_states[oldest] != SECTOR_ERASED) {
+    erase_pending |= 1u << oldest;
+  }
+}
+
+// The HAL programs whole pages, bytes left at 0xFF keep what is in flash
+void FlashStore::program(uint32_t offset, const uint8_t* data, uint32_t length) {
+  while (length > 0) {
+    uint32_t page = offset & ~(HAL_FLASH_PAGE_SIZE - 1);
+    uint32_t in_page = offset - page;
+    uint32_t chunk = HAL_FLASH_PAGE_SIZE - in_page < length ? HAL_FLASH_PAGE_SIZE - in_page : length;
+
+    memset(page_buffer, 0xFF, sizeof(page_buffer));
+    memcpy(page_buffer + in_page, data, chunk);
+    hal_flash_store_program(page, page_buffer, HAL_FLASH_PAGE_SIZE);
+
+    offset += chunk;
+    data += chunk;
+    length -= chunk;
+  }
+}
+
+void FlashStore::erase(const uint8_t sector) {
+  uint64_t start = hal_time_us();
+  hal_flash_store_erase(sector * HAL_FLASH_SECTOR_SIZE);
+  sector_states[sector] = SECTOR_ERASED;
+  erase_pending &= ~(1u << sector);
+  TRACE_INFO(TRACE_STORE_ERASE, sector, (uint32_t)(hal_time_us() - start));
+}
+
+// Erases at most one sector per call
+void FlashStore::service() {
+  for (uint8_t s = 0; s < HAL_FLASH_STORE_SECTORS; s++) {
+    if (erase_pending & (1u << s)) {
+      erase(s);
+      return;
+    }
+  }
+}
+
+bool FlashStore::isErasePending() {
+  return erase_pending != 0;
+}
+
+uint16_t FlashStore::check(const uint8_t type, const uint8_t length, const uint8_t* payload) {
+  // Fletcher-16, never 0xFFFF so an erased header can't pass
+  uint16_t sum1 = type % 255;
+  uint16_t sum2 = sum1;
+  sum1 = (sum1 + length) % 255;
+  sum2 = (sum2 + sum1) % 255;
+  for (uint8_t i = 0; i < length; i++) {
+    sum1 = (sum1 + payload[i]) % 255;
+    sum2 = (sum2 + sum1) % 255;
+  }
+  return (sum2 << 8) | sum1;
+}
@@ -0,0 +1,97 @@
+#ifndef FLASH_STORE_H
+#define FLASH_STORE_H
+
+#include "Hal.h"
+
+#define FLASH_STORE_MAGIC 0x4C53474D // "MGSL", memory game store log
+#define FLASH_STORE_RECORD_MAX 8 // payload bytes, padded to 4 in flash
+
+enum store_record_type_t {
+  STORE_RECORD_BEST = 1,   // store_best_t
+  STORE_RECORD_SESSION,    // store_session_t
+  STORE_RECORD_SETTINGS,   // store_settings_t
+  STORE_RECORD_TYPES,
+  STORE_RECORD_FREE = 0xFF // erased flash, end of a sector's log
+};
+
+struct store_sector_header_t {
+  uint32_t magic;
+  uint32_t sequence; // the highest one is the sector being appended to
+};
+
+struct store_record_header_t {
+  uint8_t type;
+  uint8_t length; // payload bytes
+  uint16_t check; // Fletcher-16 of type, length and payload
+};
+
+struct store_best_t {
+  uint8_t frames; // longest sequence remembered without a mistake
+  uint8_t reserved[3];
+};
+
+struct store_session_t {
+  uint16_t number; // counts up with every game played
+  uint8_t frames;
+  uint8_t correct; // frames remembered without a mistake
+  uint16_t score; // the fields below are 0 in records from before scoring
+  uint8_t accuracy; // percent of the pixels right
+  uint8_t reserved;
+};
+
+struct store_settings_t {
+  uint8_t frames_to_remember;
+  uint8_t brightness; // 0 in records from before it was stored
+  uint8_t reserved[2];
+};
+
+enum sector_state_t {
+  SECTOR_ERASED,
+  SECTOR_USED,  // valid header, holds part of the log
+  SECTOR_DIRTY  // neither, needs an erase before use
+};
+
+// Append-only log of small records in the flash region of the HAL. Each
+// sector starts with a header carrying a sequence number and the one with the
+// highest sequence is being appended to. A full sector moves the log on to the
+// next one round robin, which spreads the wear, starting with a snapshot of
+// the live values so that the oldest sector can be erased. The constructor
+// replays the whole region once and keeps the newest value of every record
+// type in RAM. Erasing stalls the CPU for tens of ms, so it waits for
+// service(), to be called while the game is idle.
+class FlashStore {
+public:
+  static FlashStore& getInstance();
+
+  bool read(const store_record_type_t type, void* payload, const uint8_t length);
+  bool write(const store_record_type_t type, const void* payload, const uint8_t length);
+
+  void service();
+  bool isErasePending();
+private:
+  FlashStore();
+
+  void scan();
+  uint32_t replaySector(const uint8_t sector);
+  bool isSectorErased(const uint8_t sector);
+  void append(const uint8_t type, const void* payload, const uint8_t length);
+  void rotate();
+  void program(uint32_t offset, const uint8_t* data, uint32_t length);
+  void erase(const uint8_t sector);
+  static uint16_t check(const uint8_t type, const uint8_t length, const uint8_t* payload);
+
+  sector_state_t sector_states[HAL_FLASH_STORE_SECTORS];
+  uint32_t sector_sequences[HAL_FLASH_STORE_SECTORS];
+  uint32_t erase_pending; // one bit per sector
+  int8_t active_sector; // -1 until the first write on a blank region
+  uint32_t write_offset; // in the active sector
+  uint32_t sequence;
+
+  // newest value of each record type
+  uint8_t values[STORE_RECORD_TYPES][FLASH_STORE_RECORD_MAX];
+  uint8_t lengths[STORE_RECORD_TYPES]; // 0 when never written
+
+  uint8_t page_buffer[HAL_FLASH_PAGE_SIZE];
+};
+
+#endif // FLASH_STORE_H
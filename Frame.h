@@ -0,0 +1,206 @@
+#ifndef FRAME_H
+#define FRAME_H
+
+#include <stdint.h>
+
+// Panel size of the game, override with -DLED_COUNT_X=8 -DLED_COUNT_Y=8 etc.
+#ifndef LED_COUNT_X
+#define LED_COUNT_X 5
+#endif
+#ifndef LED_COUNT_Y
+#define LED_COUNT_Y 5
+#endif
+#define LED_COUNT (LED_COUNT_X * LED_COUNT_Y)
+#define FRAME_PLANES 3 // bits per pixel
+
+enum COLORS {
+  BLACK,
+  WHITE,
+  RED,
+  GREEN,
+  BLUE,
+  YELLOW,
+  CYAN,
+  MAGENTA,
+  COLORS_COUNT
+};
+
+static_assert(COLORS_COUNT <= (1 << FRAME_PLANES), "COLORS must fit in FRAME_PLANES bits");
+
+// One bit per pixel, pixel (x, y) is bit (y * W + x)
+template <uint32_t W, uint32_t H>
+struct FrameMask {
+  static constexpr uint32_t WORDS = (W * H + 31) / 32;
+  uint32_t words[WORDS];
+
+  bool any() const {
+    uint32_t bits = 0;
+    for (uint32_t w = 0; w < WORDS; w++)
+      bits |= words[w];
+    return bits != 0;
+  }
+
+  bool test(const uint32_t x, const uint32_t y) const {
+    const uint32_t i = y * W + x;
+    return (words[i / 32] >> (i % 32)) & 1;
+  }
+
+  uint32_t count() const {
+    uint32_t bits = 0;
+    for (uint32_t w = 0; w < WORDS; w++)
+      bits += __builtin_popcount(words[w]);
+    return bits;
+  }
+
+  FrameMask operator&(const FrameMask& other) const {
+    FrameMask mask;
+    for (uint32_t w = 0; w < WORDS; w++)
+      mask.words[w] = words[w] & other.words[w];
+    return mask;
+  }
+};
+
+// A W x H frame of COLORS packed as FRAME_PLANES bitplanes: plane p holds bit
+// p of every pixel's colour, pixel (x, y) is bit (y * W + x), the same layout
+// as the glyphs in Glyphs.h. frame[x][y] reads and writes like the old
+// COLORS[W][H] arrays.
+template <uint32_t W, uint32_t H>
+struct Frame {
+  static constexpr uint32_t WIDTH = W;
+  static constexpr uint32_t HEIGHT = H;
+  static constexpr uint32_t PIXELS = W * H;
+  static constexpr uint32_t WORDS = (PIXELS + 31) / 32;
+  // pixels of the last word, the bits past them are never drawn
+  static constexpr uint32_t LAST_WORD_MASK = PIXELS % 32 != 0 ? (1u << (PIXELS % 32)) - 1 : ~0u;
+
+  uint32_t planes[FRAME_PLANES][WORDS];
+
+  COLORS getIndex(const uint32_t i) const {
+    uint32_t color = 0;
+    for (uint32_t p = 0; p < FRAME_PLANES; p++)
+      color |= ((planes[p][i / 32] >> (i % 32)) & 1) << p;
+    return (COLORS)color;
+  }
+
+  COLORS get(const uint32_t x, const uint32_t y) const {
+    return getIndex(y * W + x);
+  }
+
+  void set(const uint32_t x, const uint32_t y, const COLORS color) {
+    const uint32_t i = y * W + x;
+    const uint32_t bit = 1u << (i % 32);
+    for (uint32_t p = 0; p < FRAME_PLANES; p++) {
+      uint32_t& word = planes[p][i / 32];
+      word = (color >> p) & 1 ? word | bit : word & ~bit;
+    }
+  }
+
+  void clear() {
+    for (uint32_t p = 0; p < FRAME_PLANES; p++)
+      for (uint32_t w = 0; w < WORDS; w++)
+        planes[p][w] = 0;
+  }
+
+  // Clears the bits past the last pixel, for frames copied in from outside
+  void trim() {
+    for (uint32_t p = 0; p < FRAME_PLANES; p++)
+      planes[p][WORDS - 1] &= LAST_WORD_MASK;
+  }
+
+  // Clears the frame and sets the lit pixels of a packed glyph (bit
+  // gy * width + gx is glyph pixel (gx, gy)) to color, with its origin at (x, y)
+  void fillGlyph(
+    const uint32_t glyph,
+    const uint32_t width,
+    const uint32_t height,
+    const uint32_t x,
+    const uint32_t y,
+    const COLORS color
+  ) {
+    clear();
+    const uint32_t row_mask = (1u << width) - 1;
+    for (uint32_t gy = 0; gy < height; gy++) {
+      const uint32_t row = (glyph >> (gy * width)) & row_mask;
+      const uint32_t i = (y + gy) * W + x;
+      const uint32_t shift = i % 32;
+      for (uint32_t p = 0; p < FRAME_PLANES; p++) {
+        if (!((color >> p) & 1)) {
+          continue;
+        }
+        planes[p][i / 32] |= row << shift;
+        if (shift + width > 32) {
+          planes[p][i / 32 + 1] |= row >> (32 - shift); // row straddles two words
+        }
+      }
+    }
+  }
+
+  // Clears the frame and sets the pixels in mask to color
+  void fillMask(const FrameMask<W, H>& mask, const COLORS color) {
+    for (uint32_t p = 0; p < FRAME_PLANES; p++)
+      for (uint32_t w = 0; w < WORDS; w++)
+        planes[p][w] = (color >> p) & 1 ? mask.words[w] : 0;
+  }
+
+  // Mask of the pixels set to color
+  FrameMask<W, H> colorMask(const COLORS color) const {
+    FrameMask<W, H> mask;
+    for (uint32_t w = 0; w < WORDS; w++) {
+      uint32_t bits = ~0u;
+      for (uint32_t p = 0; p < FRAME_PLANES; p++)
+        bits &= (color >> p) & 1 ? planes[p][w] : ~planes[p][w];
+      mask.words[w] = bits;
+    }
+    mask.words[WORDS - 1] &= LAST_WORD_MASK;
+    return mask;
+  }
+
+  // Mask of the pixels whose colour differs
+  FrameMask<W, H> diff(const Frame& other) const {
+    FrameMask<W, H> mask = {};
+    for (uint32_t p = 0; p < FRAME_PLANES; p++)
+      for (uint32_t w = 0; w < WORDS; w++)
+        mask.words[w] |= planes[p][w] ^ other.planes[p][w];
+    mask.words[WORDS - 1] &= LAST_WORD_MASK;
+    return mask;
+  }
+
+  bool operator==(const Frame& other) const {
+    uint32_t bits = 0;
+    for (uint32_t p = 0; p < FRAME_PLANES; p++)
+      for (uint32_t w = 0; w < WORDS; w++)
+        bits |= planes[p][w] ^ other.planes[p][w];
+    return bits == 0;
+  }
+
+  bool operator!=(const Frame& other) const {
+    return !(*this == other);
+  }
+
+  struct pixel_ref {
+    Frame& frame;
+    const uint32_t x, y;
+    operator COLORS() const { return frame.get(x, y); }
+    pixel_ref& operator=(const COLORS color) { frame.set(x, y, color); return *this; }
+  };
+
+  struct column_ref {
+    Frame& frame;
+    const uint32_t x;
+    pixel_ref operator[](const uint32_t y) const { return {frame, x, y}; }
+  };
+
+  struct const_column_ref {
+    const Frame& frame;
+    const uint32_t x;
+    COLORS operator[](const uint32_t y) const { return frame.get(x, y); }
+  };
+
+  column_ref operator[](const uint32_t x) { return {*this, x}; }
+  const_column_ref operator[](const uint32_t x) const { return {*this, x}; }
+};
+
+typedef Frame<LED_COUNT_X, LED_COUNT_Y> frame_t;
+typedef FrameMask<LED_COUNT_X, LED_COUNT_Y> frame_mask_t;
+
+#endif // FRAME_H
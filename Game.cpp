@@ -0,0 +1,621 @@
+#include "Game.h"
+#include "Hal.h"
+#include "GPIO.h"
+#include "InputManager.h"
+#include "LedMatrix.h"
+#include "Trace.h"
+#include "Latency.h"
+#include "Link.h"
+#include "InputLog.h"
+#include "PuzzlePack.h"
+#include "Audio.h"
+
+#include <stdio.h>
+#include <string.h>
+
+static_assert(LATENCY_INIT_STATE + STATES_COUNT == LATENCY_RENDER, "one latency histogram per state");
+
+// The number of frames, SETTING_STATE
+struct setting_context_t {
+  char text[4];
+  uint64_t scroll_start; // us, the text scrolls from its start again when it changes
+};
+
+// Cursor editing of frames, FRAMER_STATE and MEMORIZER_STATE
+struct edit_context_t {
+  frame_t* frames;
+  uint8_t frame, x, y;
+};
+
+// Paging through frames, REMEMBER_STATE and FINAL_STATE
+struct review_context_t {
+  uint8_t frame;
+  COMPARE_STATE view; // FINAL_STATE only
+  uint8_t heard; // FINAL_STATE only, last frame whose verdict was played
+};
+
+state_t current_state = INIT_STATE;
+uint8_t frames_to_remember = MIN_FRAMES;
+store_settings_t settings = {MIN_FRAMES, LED_DEFAULT_BRIGHTNESS, {}};
+
+frame_t frames_framer[MAX_FRAMES];
+frame_t frames_memorizer[MAX_FRAMES];
+const frame_t* frames_solution = frames_framer;
+frame_score_t frame_scores[MAX_FRAMES];
+session_score_t session_score;
+
+static setting_context_t setting_context = {"", 0};
+static edit_context_t framer_context = {frames_framer, 0, 0, 0};
+static edit_context_t memorizer_context = {frames_memorizer, 0, 0, 0};
+static review_context_t remember_context = {0, CORRECT, 0};
+static review_context_t final_context = {0, CORRECT, 0};
+static uint64_t game_time = 0; // us, given by the last update_state()
+static uint64_t state_deadline = 0; // us, 0 when no timer is running
+static bool linked_game = false; // the frames or the turn came from the other board
+static uint16_t next_puzzle = 0; // of the pack, from the first one again with every start_game()
+
+// Jumps to a state from outside the game (Command.h). frames_framer is the
+// solution from then on, so frames loaded into RAM can be played and scored.
+void force_state(const state_t state, const uint8_t frames) {
+  if (frames >= MIN_FRAMES && frames <= MAX_FRAMES) {
+    frames_to_remember = frames;
+  }
+  linked_game = false;
+  frames_solution = frames_framer;
+  change_state(state);
+  redraw_state();
+}
+
+static void init_enter(void* context, const game_event_t& event);
+static void init_click(void* context, const game_event_t& event);
+static void init_peer(void* context, const game_event_t& event);
+static void init_draw(void* context);
+static void setting_enter(void* context, const game_event_t& event);
+static void setting_exit(void* context, const game_event_t& event);
+static void setting_click(void* context, const game_event_t& event);
+static void setting_joystick(void* context, const game_event_t& event);
+static void setting_timer(void* context, const game_event_t& event);
+static void setting_draw(void* context);
+static void edit_enter(void* context, const game_event_t& event);
+static void edit_click(void* context, const game_event_t& event);
+static void edit_joystick(void* context, const game_event_t& event);
+static void edit_timer(void* context, const game_event_t& event);
+static void edit_draw(void* context);
+static void framer_click(void* context, const game_event_t& event);
+static void memorizer_click(void* context, const game_event_t& event);
+static void review_enter(void* context, const game_event_t& event);
+static void review_click(void* context, const game_event_t& event);
+static void review_joystick(void* context, const game_event_t& event);
+static void remember_click(void* context, const game_event_t& event);
+static void remember_draw(void* context);
+static void final_enter(void* context, const game_event_t& event);
+static void final_click(void* context, const game_event_t& event);
+static void final_timer(void* context, const game_event_t& event);
+static void final_draw(void* context);
+static void peer_click(void* context, const game_event_t& event);
+static void peer_peer(void* context, const game_event_t& event);
+static void peer_draw(void* context);
+
+// Handlers in game_event_type_t order: enter, exit, click, joystick, timer, peer
+static const state_desc_t STATE_TABLE[] = {
+  // INIT_STATE
+  {{init_enter, nullptr, init_click, nullptr, nullptr, init_peer}, init_draw, nullptr},
+  // SETTING_STATE
+  {{setting_enter, setting_exit, setting_click, setting_joystick, setting_timer, nullptr}, setting_draw, &setting_context},
+  // FRAMER_STATE
+  {{edit_enter, nullptr, framer_click, edit_joystick, edit_timer, nullptr}, edit_draw, &framer_context},
+  // REMEMBER_STATE
+  {{review_enter, nullptr, remember_click, review_joystick, nullptr, nullptr}, remember_draw, &remember_context},
+  // MEMORIZER_STATE
+  {{edit_enter, nullptr, memorizer_click, edit_joystick, edit_timer, nullptr}, edit_draw, &memorizer_context},
+  // FINAL_STATE
+  {{final_enter, nullptr, final_click, review_joystick, final_timer, nullptr}, final_draw, &final_context},
+  // PEER_STATE
+  {{nullptr, nullptr, peer_click, nullptr, nullptr, peer_peer}, peer_draw, nullptr},
+};
+
+static_assert(sizeof(STATE_TABLE) / sizeof(STATE_TABLE[0]) == STATES_COUNT, "one row per state");
+
+// Also starts a game over, from wherever the current one is
+void start_game(const uint64_t now) {
+  game_time = now;
+  next_puzzle = 0;
+  current_state = INIT_STATE;
+  state_deadline = 0;
+  dispatch_event({EVENT_ENTER, 0, NEUTRAL, now});
+  redraw_state();
+}
+
+// Hands the input of the tick to the current state in the order it came, then
+// the state timer and a turn from the other board. A tick without any does
+// nothing. A turn stays with Link until a state that takes turns is current.
+bool update_state(const uint64_t now) {
+  InputManager& input_manager = InputManager::getInstance();
+  const state_t previous_state = current_state;
+  const uint64_t start = hal_time_us();
+  game_time = now;
+  bool handled = false;
+
+  button_event_t button;
+  joystick_event_t joystick;
+  bool has_button = input_manager.nextButtonEvent(&button);
+  bool has_joystick = input_manager.nextJoystickEvent(&joystick);
+  while (has_button || has_joystick) {
+    if (has_button && (!has_joystick || button.time <= joystick.time)) {
+      if (button.pressed && dispatch_event({EVENT_CLICK, button.pin, NEUTRAL, button.time})) {
+        handled = true;
+        Audio::getInstance().play(SOUND_CLICK);
+      }
+      has_button = input_manager.nextButtonEvent(&button);
+    } else {
+      if (dispatch_event({EVENT_JOYSTICK, joystick.pin, joystick.direction, joystick.time})) {
+        handled = true;
+        Audio::getInstance().play(SOUND_MOVE);
+      }
+      has_joystick = input_manager.nextJoystickEvent(&joystick);
+    }
+  }
+
+  if (state_deadline != 0 && now >= state_deadline) {
+    const uint64_t deadline = state_deadline;
+    state_deadline = 0;
+    handled |= dispatch_event({EVENT_TIMER, 0, NEUTRAL, deadline});
+  }
+
+  state_t turn;
+  if (STATE_TABLE[current_state].handlers[EVENT_PEER] != nullptr && Link::getInstance().peekTurn(&turn)) {
+    handled |= dispatch_event({EVENT_PEER, 0, NEUTRAL, now, turn});
+  }
+
+  if (!handled) {
+    return false;
+  }
+  TRACE_DEBUG(TRACE_STATE_TICK, current_state, 0);
+  redraw_state();
+  latency_record((latency_id_t)(LATENCY_INIT_STATE + previous_state), hal_time_us() - start);
+  return true;
+}
+
+// Runs the exit handler of the current state and the enter handler of the
+// next one, the caller redraws
+void change_state(const state_t state) {
+  const state_t previous_state = current_state;
+  dispatch_event({EVENT_EXIT, 0, NEUTRAL, game_time});
+  current_state = state;
+  state_deadline = 0;
+  dispatch_event({EVENT_ENTER, 0, NEUTRAL, game_time});
+  TRACE_INFO(TRACE_STATE_CHANGE, current_state, previous_state);
+  Audio::getInstance().play(SOUND_STATE);
+}
+
+// Returns false when the current state has no handler for the event
+bool dispatch_event(const game_event_t& event) {
+  const state_desc_t& state = STATE_TABLE[current_state];
+  if (state.handlers[event.type] == nullptr) {
+    return false;
+  }
+  state.handlers[event.type](state.context, event);
+  return true;
+}
+
+// Puts the current state back on the LEDs, after something else drew there
+void redraw_state() {
+  const state_desc_t& state = STATE_TABLE[current_state];
+  state.draw(state.context);
+}
+
+// Sends the current state an EVENT_TIMER on the first tick at or past the
+// deadline, changing state cancels it
+void state_timer_start(const uint64_t deadline) {
+  state_deadline = deadline;
+}
+
+void game_status(game_status_t* status) {
+  const void* context = STATE_TABLE[current_state].context;
+  *status = {current_state, 0, false, 0, 0};
+  if (context == &framer_context || context == &memorizer_context) {
+    const edit_context_t* edit = (const edit_context_t*)context;
+    *status = {current_state, edit->frame, true, edit->x, edit->y};
+  } else if (context == &remember_context || context == &final_context) {
+    status->frame = ((const review_context_t*)context)->frame;
+  }
+}
+
+static void init_enter(void* context, const game_event_t& event) {
+  (void)context;
+  (void)event;
+  linked_game = false;
+  frames_solution = frames_framer;
+}
+
+// Plays the next puzzle of the pack, straight from flash
+static void init_puzzle() {
+  PuzzlePack& pack = PuzzlePack::getInstance();
+  if (pack.getCount() == 0) {
+    return;
+  }
+  const uint16_t index = next_puzzle;
+  next_puzzle = (next_puzzle + 1) % pack.getCount();
+  uint8_t frames;
+  const frame_t* puzzle = pack.getPuzzle(index, &frames);
+  if (puzzle == nullptr) {
+    return;
+  }
+  TRACE_INFO(TRACE_PUZZLE, index, frames);
+  frames_solution = puzzle;
+  frames_to_remember = frames;
+  change_state(REMEMBER_STATE);
+}
+
+static void init_click(void* context, const game_event_t& event) {
+  (void)context;
+  if (event.pin == SW_PIN) {
+    change_state(SETTING_STATE);
+  } else if (event.pin == BTN_A_PIN) {
+    init_puzzle();
+  }
+}
+
+// The other board framed, this one remembers
+static void init_peer(void* context, const game_event_t& event) {
+  (void)context;
+  const uint8_t frames = Link::getInstance().takeTurn(frames_framer);
+  if (event.state == REMEMBER_STATE && frames >= MIN_FRAMES) {
+    frames_to_remember = frames;
+    linked_game = true;
+    change_state(REMEMBER_STATE);
+  }
+}
+
+static void init_draw(void* context) {
+  (void)context;
+  led_matrix_t::getInstance().drawGlyph(GLYPH_SMILE, MAGENTA);
+}
+
+// Text of frames_to_remember, a change scrolls it from the start again. now
+// is game time, the clock of setting_draw() and the state timer, not the
+// edge time of the input.
+static void setting_update(setting_context_t* setting, const uint64_t now) {
+  char text[sizeof(setting->text)];
+  snprintf(text, sizeof(text), "%u", frames_to_remember);
+  if (strcmp(text, setting->text) == 0) {
+    return;
+  }
+  strcpy(setting->text, text);
+  setting->scroll_start = now;
+  if (led_matrix_t::textWidth(text) > LED_COUNT_X) {
+    state_timer_start(now + SCROLL_STEP_MS * 1000);
+  } else {
+    state_timer_start(0);
+  }
+}
+
+static void setting_enter(void* context, const game_event_t& event) {
+  setting_context_t* setting = (setting_context_t*)context;
+  frames_to_remember = settings.frames_to_remember;
+  setting->text[0] = '\0';
+  setting_update(setting, event.time);
+}
+
+static void setting_exit(void* context, const game_event_t& event) {
+  (void)context;
+  (void)event;
+  settings.frames_to_remember = frames_to_remember;
+  settings.brightness = led_matrix_t::getInstance().getBrightness();
+  if (InputLog::getInstance().getMode() != INPUT_LOG_REPLAY) {
+    FlashStore::getInstance().write(STORE_RECORD_SETTINGS, &settings, sizeof(settings));
+  }
+}
+
+static void setting_click(void* context, const game_event_t& event) {
+  if (event.pin == SW_PIN) {
+    change_state(FRAMER_STATE);
+    return;
+  }
+  if (event.pin == BTN_A_PIN && frames_to_remember > MIN_FRAMES) {
+    frames_to_remember--;
+  } else if (event.pin == BTN_B_PIN && frames_to_remember < MAX_FRAMES) {
+    frames_to_remember++;
+  }
+  TRACE_DEBUG(TRACE_FRAMES_TO_REMEMBER, frames_to_remember, 0);
+  setting_update((setting_context_t*)context, game_time);
+}
+
+static void setting_joystick(void* context, const game_event_t& event) {
+  if (event.pin == JST_X_PIN) {
+    if (event.direction == NEG && frames_to_remember > MIN_FRAMES) {
+      frames_to_remember--;
+    } else if (event.direction == POS && frames_to_remember < MAX_FRAMES) {
+      frames_to_remember++;
+    }
+    TRACE_DEBUG(TRACE_FRAMES_TO_REMEMBER, frames_to_remember, 0);
+    setting_update((setting_context_t*)context, game_time);
+    return;
+  }
+
+  // joystick up and down doubles or halves the brightness
+  led_matrix_t& led_matrix = led_matrix_t::getInstance();
+  uint8_t brightness = led_matrix.getBrightness();
+  if (event.direction == POS) {
+    brightness = brightness >= 128 ? 255 : brightness * 2;
+  } else if (brightness / 2 >= MIN_BRIGHTNESS) {
+    brightness /= 2;
+  }
+  led_matrix.setBrightness(brightness);
+}
+
+// One scroll step, the position of the text follows the clock
+static void setting_timer(void* context, const game_event_t& event) {
+  (void)context;
+  state_timer_start(event.time + SCROLL_STEP_MS * 1000);
+}
+
+static void setting_draw(void* context) {
+  setting_context_t* setting = (setting_context_t*)context;
+  const uint32_t step = (game_time - setting->scroll_start) / 1000 / SCROLL_STEP_MS;
+  led_matrix_t::getInstance().drawText(setting->text, step, BLUE);
+}
+
+// Blink phase follows the clock, the timer fires when it flips
+static void blink_timer_start(const uint64_t now) {
+  state_timer_start((now / 1000 / BLINK_PERIOD_MS + 1) * BLINK_PERIOD_MS * 1000);
+}
+
+static void edit_enter(void* context, const game_event_t& event) {
+  edit_context_t* edit = (edit_context_t*)context;
+  for (uint8_t i = 0; i < frames_to_remember; i++) {
+    led_matrix_t::clear(edit->frames[i]);
+  }
+  edit->frame = 0;
+  edit->x = 0;
+  edit->y = 0;
+  blink_timer_start(event.time);
+}
+
+// A and B step the colour under the cursor down and up
+static void edit_click(void* context, const game_event_t& event) {
+  edit_context_t* edit = (edit_context_t*)context;
+  frame_t& frame = edit->frames[edit->frame];
+  int color = frame.get(edit->x, edit->y);
+  if (event.pin == BTN_A_PIN) {
+    color = color > 0 ? color - 1 : COLORS_COUNT - 1;
+  } else if (event.pin == BTN_B_PIN) {
+    color = (color + 1) % COLORS_COUNT;
+  }
+  frame.set(edit->x, edit->y, (COLORS)color);
+}
+
+// X moves the cursor across the row and on to the neighbouring frame at its
+// ends, Y wraps around the column
+static void edit_joystick(void* context, const game_event_t& event) {
+  edit_context_t* edit = (edit_context_t*)context;
+  if (event.pin == JST_X_PIN) {
+    if (event.direction == NEG) {
+      if (edit->x > 0) {
+        edit->x--;
+      } else if (edit->frame > 0) {
+        edit->x = LED_COUNT_X - 1;
+        edit->frame--;
+      }
+    } else {
+      if (edit->x + 1 < LED_COUNT_X) {
+        edit->x++;
+      } else if (edit->frame + 1 < frames_to_remember) {
+        edit->x = 0;
+        edit->frame++;
+      }
+    }
+    return;
+  }
+
+  if (event.direction == NEG) {
+    edit->y = edit->y > 0 ? edit->y - 1 : LED_COUNT_Y - 1;
+  } else {
+    edit->y = edit->y + 1 < LED_COUNT_Y ? edit->y + 1 : 0;
+  }
+}
+
+static void edit_timer(void* context, const game_event_t& event) {
+  (void)context;
+  blink_timer_start(event.time);
+}
+
+static void edit_draw(void* context) {
+  edit_context_t* edit = (edit_context_t*)context;
+  led_matrix_t& led_matrix = led_matrix_t::getInstance();
+  led_matrix.setLEDs(edit->frames[edit->frame]);
+
+  // the cursor blinks black and its colour, white over black pixels
+  COLORS color = edit->frames[edit->frame].get(edit->x, edit->y);
+  if ((game_time / 1000 / BLINK_PERIOD_MS) % 2) {
+    color = color == BLACK ? WHITE : color;
+  } else {
+    color = BLACK;
+  }
+  led_matrix.setLED(edit->x, edit->y, color);
+}
+
+static void framer_click(void* context, const game_event_t& event) {
+  if (event.pin == SW_PIN) {
+    // with a peer the other board remembers, a full link window drops the click
+    Link& link = Link::getInstance();
+    if (!link.isUp()) {
+      change_state(REMEMBER_STATE);
+    } else if (link.sendTurn(REMEMBER_STATE, frames_framer, frames_to_remember)) {
+      linked_game = true;
+      change_state(PEER_STATE);
+    }
+    return;
+  }
+  edit_click(context, event);
+}
+
+static void memorizer_click(void* context, const game_event_t& event) {
+  if (event.pin == SW_PIN) {
+    if (linked_game) {
+      Link::getInstance().sendTurn(FINAL_STATE, frames_memorizer, frames_to_remember);
+    }
+    change_state(FINAL_STATE);
+    return;
+  }
+  edit_click(context, event);
+}
+
+static void review_enter(void* context, const game_event_t& event) {
+  (void)event;
+  ((review_context_t*)context)->frame = 0;
+}
+
+// A, B and joystick X page through the frames
+static void review_page(review_context_t* review, const bool forward) {
+  if (!forward && review->frame > 0) {
+    review->frame--;
+  } else if (forward && review->frame + 1 < frames_to_remember) {
+    review->frame++;
+  }
+}
+
+static void review_click(void* context, const game_event_t& event) {
+  if (event.pin == BTN_A_PIN || event.pin == BTN_B_PIN) {
+    review_page((review_context_t*)context, event.pin == BTN_B_PIN);
+  }
+}
+
+static void review_joystick(void* context, const game_event_t& event) {
+  if (event.pin == JST_X_PIN) {
+    review_page((review_context_t*)context, event.direction == POS);
+  }
+}
+
+static void remember_click(void* context, const game_event_t& event) {
+  if (event.pin == SW_PIN) {
+    change_state(MEMORIZER_STATE);
+    return;
+  }
+  review_click(context, event);
+}
+
+static void remember_draw(void* context) {
+  review_context_t* review = (review_context_t*)context;
+  led_matrix_t::getInstance().setLEDs(frames_solution[review->frame]);
+}
+
+static void final_enter(void* context, const game_event_t& event) {
+  review_context_t* review = (review_context_t*)context;
+  score_session(frames_solution, frames_memorizer, frames_to_remember, frame_scores, &session_score);
+  TRACE_INFO(TRACE_SCORE, session_score.perfect_frames | (session_score.frames << 8), session_score.total);
+  if (InputLog::getInstance().getMode() != INPUT_LOG_REPLAY) {
+    save_results(); // a replayed game was played already
+  }
+  review->frame = 0;
+  review->view = CORRECT;
+  review->heard = MAX_FRAMES; // none yet
+  state_timer_start(event.time + COMPARE_VIEW_MS * 1000);
+}
+
+static void final_click(void* context, const game_event_t& event) {
+  if (event.pin == SW_PIN) {
+    change_state(INIT_STATE);
+    return;
+  }
+  review_click(context, event);
+}
+
+// Cycles the solution, the player's frame, the wrong pixels and the verdict
+static void final_timer(void* context, const game_event_t& event) {
+  review_context_t* review = (review_context_t*)context;
+  review->view = review->view == COMPARE ? CORRECT : (COMPARE_STATE)((int)review->view + 1);
+  state_timer_start(event.time + COMPARE_VIEW_MS * 1000);
+
+  // the verdict sounds the first time it shows for a frame
+  if (review->view == COMPARE && review->heard != review->frame) {
+    review->heard = review->frame;
+    Audio::getInstance().play(frame_scores[review->frame].wrong.any() ? SOUND_CROSS : SOUND_CHECK);
+  }
+}
+
+static void final_draw(void* context) {
+  review_context_t* review = (review_context_t*)context;
+  led_matrix_t& led_matrix = led_matrix_t::getInstance();
+
+  switch (review->view) {
+  case CORRECT:
+    led_matrix.setLEDs(frames_solution[review->frame]);
+    break;
+  case PLAYER:
+    led_matrix.setLEDs(frames_memorizer[review->frame]);
+    break;
+  case WRONG: {
+    frame_t wrong_pixels;
+    wrong_pixels.fillMask(frame_scores[review->frame].wrong, RED);
+    led_matrix.setLEDs(wrong_pixels);
+    break;
+  }
+  case COMPARE:
+    if (!frame_scores[review->frame].wrong.any()) {
+      led_matrix.drawGlyph(GLYPH_CHECK, GREEN);
+    } else {
+      led_matrix.drawGlyph(GLYPH_CROSS, RED);
+    }
+    break;
+  default:
+    break;
+  }
+}
+
+// SW gives up on the other board
+static void peer_click(void* context, const game_event_t& event) {
+  (void)context;
+  if (event.pin == SW_PIN) {
+    change_state(INIT_STATE);
+  }
+}
+
+// The other board played, its frames are the ones to score
+static void peer_peer(void* context, const game_event_t& event) {
+  (void)context;
+  const uint8_t frames = Link::getInstance().takeTurn(frames_memorizer);
+  if (event.state == FINAL_STATE && frames == frames_to_remember) {
+    change_state(FINAL_STATE);
+  }
+}
+
+static void peer_draw(void* context) {
+  (void)context;
+  led_matrix_t::getInstance().drawGlyph(GLYPH_WAIT, CYAN);
+}
+
+void load_settings() {
+  FlashStore& store = FlashStore::getInstance();
+  if (
+    !store.read(STORE_RECORD_SETTINGS, &settings, sizeof(settings)) ||
+    settings.frames_to_remember < MIN_FRAMES ||
+    settings.frames_to_remember > MAX_FRAMES
+  ) {
+    settings = {MIN_FRAMES, LED_DEFAULT_BRIGHTNESS, {}};
+  }
+  if (settings.brightness < MIN_BRIGHTNESS) {
+    settings.brightness = LED_DEFAULT_BRIGHTNESS;
+  }
+  led_matrix_t::getInstance().setBrightness(settings.brightness);
+}
+
+void save_results() {
+  FlashStore& store = FlashStore::getInstance();
+
+  store_session_t session = {};
+  store.read(STORE_RECORD_SESSION, &session, sizeof(session));
+  session.number++;
+  session.frames = session_score.frames;
+  session.correct = session_score.perfect_frames;
+  session.accuracy = session_score.accuracy;
+  session.score = session_score.total > UINT16_MAX ? UINT16_MAX : session_score.total;
+  store.write(STORE_RECORD_SESSION, &session, sizeof(session));
+
+  store_best_t best = {};
+  store.read(STORE_RECORD_BEST, &best, sizeof(best));
+  if (session.correct == session.frames && session.frames > best.frames) {
+    best.frames = session.frames;
+    store.write(STORE_RECORD_BEST, &best, sizeof(best));
+  }
+}
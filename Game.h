@@ -0,0 +1,99 @@
+#ifndef GAME_H
+#define GAME_H
+
+#include "Frame.h"
+#include "Scoring.h"
+#include "FlashStore.h"
+#include "InputManager.h"
+
+// Game states and the data they share. Each state is a row of handlers in a
+// table (Game.cpp) and only runs when an event reaches it: update_state()
+// turns the input of one logic tick and an expired state timer into events,
+// the main loop (Memory_game.cpp) decides when. The game never reads the
+// clock: its time is given to update_state(), so a replayed log plays the
+// same game (InputLog.h).
+#define BLINK_PERIOD_MS 250
+#define COMPARE_VIEW_MS 250
+#define SCROLL_STEP_MS 150 // text too long for the panel moves a column this often
+#define MAX_FRAMES 32
+#define MIN_FRAMES 1
+#define MIN_BRIGHTNESS 4
+
+enum state_t {
+  INIT_STATE,
+  SETTING_STATE,
+  FRAMER_STATE,
+  REMEMBER_STATE,
+  MEMORIZER_STATE,
+  FINAL_STATE,
+  PEER_STATE, // two-player, waiting for the other board to play
+  STATES_COUNT
+};
+enum COMPARE_STATE {
+    CORRECT,
+    PLAYER,
+    WRONG,
+    COMPARE,
+    COMPARE_STATE_COUNT
+  };
+
+enum game_event_type_t {
+  EVENT_ENTER,
+  EVENT_EXIT,
+  EVENT_CLICK,    // pin pressed
+  EVENT_JOYSTICK, // pin stepped towards direction
+  EVENT_TIMER,    // the deadline of state_timer_start() passed
+  EVENT_PEER,     // the other board handed over the turn, see Link.h
+  EVENT_TYPES
+};
+
+struct game_event_t {
+  game_event_type_t type;
+  uint8_t pin;
+  direction_t direction;
+  uint64_t time; // us
+  state_t state = INIT_STATE; // EVENT_PEER: where the other board wants this one to go
+};
+
+typedef void (*state_handler_t)(void* context, const game_event_t& event);
+typedef void (*state_draw_t)(void* context);
+
+// A row of the state table. Handlers are nullptr for events the state
+// ignores, draw() puts the state on the LEDs after its handlers ran.
+struct state_desc_t {
+  state_handler_t handlers[EVENT_TYPES];
+  state_draw_t draw;
+  void* context;
+};
+
+// Where the player is in the current state, for the status display
+struct game_status_t {
+  state_t state;
+  uint8_t frame; // edited or looked at, FRAMER_STATE to FINAL_STATE
+  bool cursor; // x and y hold the cursor, FRAMER_STATE and MEMORIZER_STATE
+  uint8_t x, y;
+};
+
+extern state_t current_state;
+extern uint8_t frames_to_remember;
+extern store_settings_t settings;
+
+extern frame_t frames_framer[MAX_FRAMES];
+extern frame_t frames_memorizer[MAX_FRAMES];
+extern const frame_t* frames_solution; // frames_framer, or a puzzle of PuzzlePack.h in flash
+extern frame_score_t frame_scores[MAX_FRAMES]; // computed once on entering FINAL_STATE
+extern session_score_t session_score;
+
+void start_game(const uint64_t now);
+bool update_state(const uint64_t now);
+void change_state(const state_t state);
+bool dispatch_event(const game_event_t& event);
+void redraw_state();
+void state_timer_start(const uint64_t deadline);
+void game_status(game_status_t* status);
+void force_state(const state_t state, const uint8_t frames);
+
+void load_settings();
+void save_results();
+
+#endif // GAME_H
@@ -0,0 +1,225 @@
+#ifndef GLYPHS_H
+#define GLYPHS_H
+
+#include <stdint.h>
+#include "Frame.h"
+
+#define GLYPH_WIDTH 5
+#define GLYPH_HEIGHT 5
+
+static_assert(GLYPH_WIDTH <= LED_COUNT_X && GLYPH_HEIGHT <= LED_COUNT_Y, "glyphs must fit on the panel");
+
+enum GLYPHS {
+  GLYPH_ZERO,
+  GLYPH_ONE,
+  GLYPH_TWO,
+  GLYPH_THREE,
+  GLYPH_FOUR,
+  GLYPH_FIVE,
+  GLYPH_SIX,
+  GLYPH_SEVEN,
+  GLYPH_EIGHT,
+  GLYPH_NINE,
+  GLYPH_SMILE,
+  GLYPH_CHECK,
+  GLYPH_CROSS,
+  GLYPH_WAIT,
+  GLYPHS_COUNT
+};
+
+// Packs 5x5 art (top row first, '#' is lit) so that bit (y * GLYPH_WIDTH + x) is LED (x, y)
+constexpr uint32_t glyph(const char (&art)[GLYPH_WIDTH * GLYPH_HEIGHT + 1]) {
+  uint32_t bits = 0;
+  for (int y = 0; y < GLYPH_HEIGHT; y++)
+    for (int x = 0; x < GLYPH_WIDTH; x++)
+      if (art[(GLYPH_HEIGHT - 1 - y) * GLYPH_WIDTH + x] == '#')
+        bits |= 1u << (y * GLYPH_WIDTH + x);
+  return bits;
+}
+
+constexpr uint32_t GLYPH_FONT[GLYPHS_COUNT] = {
+  glyph( // GLYPH_ZERO
+    ".###."
+    ".#.#."
+    ".#.#."
+    ".#.#."
+    ".###."
+  ),
+  glyph( // GLYPH_ONE
+    "..#.."
+    ".##.."
+    "..#.."
+    "..#.."
+    ".###."
+  ),
+  glyph( // GLYPH_TWO
+    ".###."
+    "...#."
+    ".###."
+    ".#..."
+    ".###."
+  ),
+  glyph( // GLYPH_THREE
+    ".###."
+    "...#."
+    ".###."
+    "...#."
+    ".###."
+  ),
+  glyph( // GLYPH_FOUR
+    ".#.#."
+    ".#.#."
+    ".###."
+    "...#."
+    "...#."
+  ),
+  glyph( // GLYPH_FIVE
+    ".###."
+    ".#..."
+    ".###."
+    "...#."
+    ".###."
+  ),
+  glyph( // GLYPH_SIX
+    ".###."
+    ".#..."
+    ".###."
+    ".#.#."
+    ".###."
+  ),
+  glyph( // GLYPH_SEVEN
+    ".###."
+    "...#."
+    "...#."
+    "...#."
+    "...#."
+  ),
+  glyph( // GLYPH_EIGHT
+    ".###."
+    ".#.#."
+    ".###."
+    ".#.#."
+    ".###."
+  ),
+  glyph( // GLYPH_NINE
+    ".###."
+    ".#.#."
+    ".###."
+    "...#."
+    ".###."
+  ),
+  glyph( // GLYPH_SMILE
+    ".#.#."
+    ".#.#."
+    "....."
+    "#...#"
+    "#####"
+  ),
+  glyph( // GLYPH_CHECK
+    "....."
+    "....#"
+    "...#."
+    "#.#.."
+    ".#..."
+  ),
+  glyph( // GLYPH_CROSS
+    "#...#"
+    ".#.#."
+    "..#.."
+    ".#.#."
+    "#...#"
+  ),
+  glyph( // GLYPH_WAIT
+    "#####"
+    ".###."
+    "..#.."
+    ".###."
+    "#####"
+  )
+};
+
+// Narrow font for text and numbers too long for one glyph, read a column at a
+// time as the text scrolls (LedMatrix::drawText)
+#define FONT_WIDTH 3
+#define FONT_HEIGHT 5
+#define FONT_SPACING 1 // blank columns between two characters
+#define FONT_ADVANCE (FONT_WIDTH + FONT_SPACING)
+#define FONT_COLUMN_MASK ((1u << FONT_HEIGHT) - 1)
+#define FONT_CHARS " 0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ-:!%."
+
+static_assert(FONT_HEIGHT <= LED_COUNT_Y, "text must fit on the panel");
+
+// Packs 3x5 art (top row first, '#' is lit) by columns, so that bit
+// (x * FONT_HEIGHT + y) is LED (x, y)
+constexpr uint16_t font_glyph(const char (&art)[FONT_WIDTH * FONT_HEIGHT + 1]) {
+  uint16_t bits = 0;
+  for (int x = 0; x < FONT_WIDTH; x++)
+    for (int y = 0; y < FONT_HEIGHT; y++)
+      if (art[(FONT_HEIGHT - 1 - y) * FONT_WIDTH + x] == '#')
+        bits |= 1u << (x * FONT_HEIGHT + y);
+  return bits;
+}
+
+// In the order of FONT_CHARS
+constexpr uint16_t FONT[] = {
+  font_glyph("..." "..." "..." "..." "..."), // ' '
+  font_glyph("###" "#.#" "#.#" "#.#" "###"), // '0'
+  font_glyph(".#." "##." ".#." ".#." "###"), // '1'
+  font_glyph("###" "..#" "###" "#.." "###"), // '2'
+  font_glyph("###" "..#" "###" "..#" "###"), // '3'
+  font_glyph("#.#" "#.#" "###" "..#" "..#"), // '4'
+  font_glyph("###" "#.." "###" "..#" "###"), // '5'
+  font_glyph("###" "#.." "###" "#.#" "###"), // '6'
+  font_glyph("###" "..#" "..#" "..#" "..#"), // '7'
+  font_glyph("###" "#.#" "###" "#.#" "###"), // '8'
+  font_glyph("###" "#.#" "###" "..#" "###"), // '9'
+  font_glyph(".#." "#.#" "###" "#.#" "#.#"), // 'A'
+  font_glyph("##." "#.#" "##." "#.#" "##."), // 'B'
+  font_glyph(".##" "#.." "#.." "#.." ".##"), // 'C'
+  font_glyph("##." "#.#" "#.#" "#.#" "##."), // 'D'
+  font_glyph("###" "#.." "##." "#.." "###"), // 'E'
+  font_glyph("###" "#.." "##." "#.." "#.."), // 'F'
+  font_glyph(".##" "#.." "#.#" "#.#" ".##"), // 'G'
+  font_glyph("#.#" "#.#" "###" "#.#" "#.#"), // 'H'
+  font_glyph("###" ".#." ".#." ".#." "###"), // 'I'
+  font_glyph("..#" "..#" "..#" "#.#" ".#."), // 'J'
+  font_glyph("#.#" "#.#" "##." "#.#" "#.#"), // 'K'
+  font_glyph("#.." "#.." "#.." "#.." "###"), // 'L'
+  font_glyph("#.#" "###" "###" "#.#" "#.#"), // 'M'
+  font_glyph("##." "#.#" "#.#" "#.#" "#.#"), // 'N'
+  font_glyph(".#." "#.#" "#.#" "#.#" ".#."), // 'O'
+  font_glyph("##." "#.#" "##." "#.." "#.."), // 'P'
+  font_glyph(".#." "#.#" "#.#" "###" ".##"), // 'Q'
+  font_glyph("##." "#.#" "##." "#.#" "#.#"), // 'R'
+  font_glyph(".##" "#.." ".#." "..#" "##."), // 'S'
+  font_glyph("###" ".#." ".#." ".#." ".#."), // 'T'
+  font_glyph("#.#" "#.#" "#.#" "#.#" "###"), // 'U'
+  font_glyph("#.#" "#.#" "#.#" "#.#" ".#."), // 'V'
+  font_glyph("#.#" "#.#" "###" "###" "#.#"), // 'W'
+  font_glyph("#.#" "#.#" ".#." "#.#" "#.#"), // 'X'
+  font_glyph("#.#" "#.#" ".#." ".#." ".#."), // 'Y'
+  font_glyph("###" "..#" ".#." "#.." "###"), // 'Z'
+  font_glyph("..." "..." "###" "..." "..."), // '-'
+  font_glyph("..." ".#." "..." ".#." "..."), // ':'
+  font_glyph(".#." ".#." ".#." "..." ".#."), // '!'
+  font_glyph("#.." "..#" ".#." "#.." "..#"), // '%'
+  font_glyph("..." "..." "..." "..." ".#."), // '.'
+};
+
+static_assert(sizeof(FONT) / sizeof(FONT[0]) == sizeof(FONT_CHARS) - 1, "one glyph per character");
+
+// Index in FONT, lower case letters come out in upper case and anything
+// missing as a space
+constexpr uint8_t font_index(char c) {
+  if (c >= 'a' && c <= 'z') {
+    c = c - 'a' + 'A';
+  }
+  for (uint8_t i = 0; i < sizeof(FONT_CHARS) - 1; i++) {
+    if (FONT_CHARS[i] == c) {
+      return i;
+    }
+  }
+  return 0;
+}
+
+#endif // GLYPHS_H
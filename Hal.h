@@ -0,0 +1,113 @@
+#ifndef HAL_H
+#define HAL_H
+
+// Thin hardware abstraction between the game and the board. HalPico.cpp
+// implements it with the Pico SDK, HalHost.cpp with a virtual clock, scripted
+// inputs and a captured LED stream for the headless simulator (HAL_HOST).
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#if HAL_HOST
+typedef unsigned int uint;
+#else
+#include "pico/types.h"
+#endif
+
+typedef void (*hal_callback_t)();
+typedef void (*hal_pin_callback_t)(uint pin);
+
+void hal_init();
+
+// Time, in microseconds since boot (virtual on the host)
+uint64_t hal_time_us();
+void hal_sleep_until_us(uint64_t time_us);
+
+// Differs from one boot (one run on the host) to the next, not for crypto
+uint32_t hal_random();
+
+// Masks interrupts on the calling core
+uint32_t hal_irq_save();
+void hal_irq_restore(uint32_t state);
+
+// 0, or 1 on the second core of DUAL_CORE_MODE
+uint hal_core_num();
+
+// Calls callback every period_us from interrupt context
+bool hal_start_periodic(uint32_t period_us, hal_callback_t callback);
+
+// Low power idle: stops the periodic callbacks and the ADC, scales the clocks
+// down and sleeps until a button edge, then restores them all. The edge
+// callback runs as usual. Returns the time of the waking edge.
+uint64_t hal_idle_until_button();
+
+// Buttons: input with pull-up, callback on both edges from interrupt context
+void hal_gpio_init_button(uint pin);
+bool hal_gpio_get(uint pin);
+void hal_gpio_set_edge_callback(uint pin, hal_pin_callback_t callback);
+
+// ADC: free-running round-robin over input_mask starting at first_input,
+// results written to ring (1 << ring_bits samples, aligned to its size)
+void hal_adc_init_pin(uint pin);
+void hal_adc_start_ring(
+  uint32_t input_mask,
+  uint first_input,
+  uint32_t sample_rate,
+  volatile uint16_t* ring,
+  uint ring_bits
+);
+uint32_t hal_adc_ring_write_index();
+
+// WS2812 chain: words are pixels in wire order, one GRB pixel per word in
+// the top 24 bits, G highest.
+// hal_led_write() returns at once, done runs after the RESET gap.
+void hal_led_init(uint pin, hal_callback_t done);
+void hal_led_write(const uint32_t* words, uint count);
+
+// Audio: a PWM level of 0..HAL_AUDIO_LEVELS - 1 on pin for every sample,
+// fed by DMA at sample_rate from two buffers of HAL_AUDIO_BUFFER samples. fill
+// runs from interrupt context whenever a buffer has been played, to refill it
+// while the other one plays. The host writes the levels to a WAV file.
+#define HAL_AUDIO_LEVELS 256
+#define HAL_AUDIO_BUFFER 256
+typedef void (*hal_audio_fill_t)(uint16_t* samples, uint count);
+void hal_audio_init(uint pin, uint32_t sample_rate, hal_audio_fill_t fill);
+
+// I2C controller, writes only: hal_i2c_write() hands the bytes to DMA and
+// returns at once, false while the last write is still going out. A target
+// that doesn't answer drops the write. The host bus has an SSD1306 on it.
+#define HAL_I2C_MAX_WRITE 160 // bytes in one write
+void hal_i2c_init(uint sda, uint scl, uint32_t baud);
+bool hal_i2c_write(uint8_t address, const uint8_t* data, uint length);
+bool hal_i2c_busy();
+
+// Persistent storage: the last HAL_FLASH_STORE_SECTORS sectors of flash (a
+// file on the host). Reads go straight through hal_flash_store_data(), XIP on
+// the board. Programming only clears bits and takes whole pages, erasing sets
+// a whole sector back to 0xFF. Offsets are from the start of the region.
+#define HAL_FLASH_PAGE_SIZE 256
+#define HAL_FLASH_SECTOR_SIZE 4096
+#ifndef HAL_FLASH_STORE_SECTORS
+#define HAL_FLASH_STORE_SECTORS 4
+#endif
+#define HAL_FLASH_STORE_SIZE (HAL_FLASH_STORE_SECTORS * HAL_FLASH_SECTOR_SIZE)
+const uint8_t* hal_flash_store_data();
+void hal_flash_store_program(uint32_t offset, const uint8_t* data, uint32_t length);
+void hal_flash_store_erase(uint32_t offset);
+
+// Raw bytes to and from the host (USB CDC on the board), reads return -1
+// when nothing is waiting
+void hal_stdio_write(const void* data, uint length);
+int hal_stdio_read();
+
+#if HAL_HOST
+// Host only, for programs other than the game (Benchmark.cpp): latched frames
+// are no longer printed and the script doesn't end the run
+void hal_host_benchmark_mode();
+// Host only, for simulators talking to each other (TransportHost.cpp): the
+// virtual clock no longer runs ahead of the wall clock
+void hal_host_realtime_mode();
+#endif
+
+#endif // HAL_H
@@ -0,0 +1,695 @@
+// Host backend of Hal.h for the headless simulator. Time is virtual: sleeping
+// jumps the clock straight to the next timer, scripted input or LED latch, so
+// whole games run in milliseconds.
+//
+// MEMORY_GAME_SCRIPT names the input script, one command per line:
+//   <time_ms> press|release|click A|B|SW
+//   <time_ms> joy X|Y <adc value 0..4095>
+//   <time_ms> serial <characters sent over stdio>
+//   <time_ms> send <file whose bytes are sent over stdio>
+//   <time_ms> end
+// Lines starting with '#' are comments. Latched LED frames are printed to
+// stdout in wire order, MEMORY_GAME_TRACE names a file for the binary trace.
+// MEMORY_GAME_FLASH names the file backing the flash store, which otherwise
+// starts erased and is lost on exit. MEMORY_GAME_AUDIO names a WAV file for
+// the audio levels, 8-bit mono. MEMORY_GAME_OLED names a PBM image for what
+// the SSD1306 on the I2C bus shows when the run ends.
+
+#include "Hal.h"
+#include "GPIO.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define HAL_MAX_PERIODIC 4
+#define HAL_GPIO_COUNT 30
+#define HAL_ADC_INPUTS 5
+#define HAL_MAX_SCRIPT 4096
+#define HAL_MAX_LEDS 1024
+#define HAL_SERIAL_SIZE 1024 // a whole upload of tools/command.py
+#define HAL_CLICK_US 50000 // press to release of a scripted click
+#define HAL_DEFAULT_END_US 1000000 // run time past the last scripted input
+#define LED_WORD_US 30 // 24 bits at 800kHz
+#define LED_RESET_US 100 // RESET signal from datasheet
+#define I2C_BYTE_BITS 9 // 8 data bits and the ACK
+#define SSD1306_WIDTH 128
+#define SSD1306_PAGES 8 // of 8 rows, bit 0 at the top
+
+enum script_action_t {
+  SCRIPT_PRESS,
+  SCRIPT_RELEASE,
+  SCRIPT_JOY,
+  SCRIPT_SERIAL,
+  SCRIPT_END
+};
+
+struct script_event_t {
+  uint64_t time_us;
+  script_action_t action;
+  uint pin;
+  uint16_t value;
+};
+
+struct periodic_t {
+  uint64_t period_us;
+  uint64_t next_us;
+  hal_callback_t callback;
+};
+
+static uint64_t now_us = 0;
+
+static periodic_t periodics[HAL_MAX_PERIODIC];
+static uint8_t periodic_count = 0;
+
+static script_event_t script[HAL_MAX_SCRIPT];
+static uint32_t script_count = 0;
+static uint32_t script_next = 0;
+
+static bool gpio_levels[HAL_GPIO_COUNT];
+static hal_pin_callback_t edge_callbacks[HAL_GPIO_COUNT];
+
+static uint16_t adc_values[HAL_ADC_INPUTS];
+static uint32_t adc_input_mask = 0;
+static uint adc_first_input = 0;
+static volatile uint16_t* adc_ring = nullptr;
+static uint32_t adc_ring_size = 0;
+
+static hal_callback_t led_done_callback = nullptr;
+static uint32_t led_frame[HAL_MAX_LEDS];
+static uint led_count = 0;
+static bool led_busy = false;
+static uint64_t led_done_us = 0;
+static uint32_t led_frames = 0;
+static bool benchmark_mode = false;
+static bool realtime_mode = false;
+static timespec realtime_start;
+static bool idle = false; // periodic callbacks are stopped until a button edge
+
+static FILE* trace_file = nullptr;
+
+static FILE* audio_file = nullptr;
+static hal_audio_fill_t audio_fill = nullptr;
+static uint32_t audio_sample_rate = 0;
+static uint64_t audio_start_us = 0;
+static uint64_t audio_samples = 0; // written to audio_file
+static uint64_t audio_done_us = 0; // the buffer being played runs out
+
+static uint8_t serial_input[HAL_SERIAL_SIZE];
+static uint32_t serial_head = 0, serial_tail = 0;
+
+static uint32_t i2c_baud = 0;
+static uint64_t i2c_done_us = 0;
+
+// What the SSD1306 holds, and where the next data byte goes
+static uint8_t ssd1306_ram[SSD1306_PAGES][SSD1306_WIDTH];
+static bool ssd1306_on = false;
+static uint8_t ssd1306_columns[2] = {0, SSD1306_WIDTH - 1};
+static uint8_t ssd1306_pages[2] = {0, SSD1306_PAGES - 1};
+static uint8_t ssd1306_column = 0, ssd1306_page = 0;
+static uint8_t ssd1306_command[3]; // with its arguments, as they come in
+static uint8_t ssd1306_command_length = 0;
+static const char* oled_path = nullptr;
+
+static uint8_t flash_store[HAL_FLASH_STORE_SIZE];
+static FILE* flash_file = nullptr;
+
+static bool parse_pin(const char* name, uint* pin) {
+  if (strcmp(name, "A") == 0) {
+    *pin = BTN_A_PIN;
+  } else if (strcmp(name, "B") == 0) {
+    *pin = BTN_B_PIN;
+  } else if (strcmp(name, "SW") == 0) {
+    *pin = SW_PIN;
+  } else if (strcmp(name, "X") == 0) {
+    *pin = JST_X_PIN;
+  } else if (strcmp(name, "Y") == 0) {
+    *pin = JST_Y_PIN;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+static void add_script_event(uint64_t time_us, script_action_t action, uint pin, uint16_t value) {
+  if (script_count >= HAL_MAX_SCRIPT) {
+    fprintf(stderr, "script: more than %d events\n", HAL_MAX_SCRIPT);
+    exit(2);
+  }
+  // keep the script sorted, clicks insert their release out of order
+  uint32_t i = script_count++;
+  while (i > 0 && script[i - 1].time_us > time_us) {
+    script[i] = script[i - 1];
+    i--;
+  }
+  script[i] = {time_us, action, pin, value};
+}
+
+static void add_script_file(uint64_t time_us, const char* path) {
+  FILE* file = fopen(path, "rb");
+  if (file == nullptr) {
+    fprintf(stderr, "script: can't open %s\n", path);
+    exit(2);
+  }
+  int c;
+  while ((c = fgetc(file)) != EOF) {
+    add_script_event(time_us, SCRIPT_SERIAL, 0, (uint8_t)c);
+  }
+  fclose(file);
+}
+
+static void load_script(const char* path) {
+  FILE* file = fopen(path, "r");
+  if (file == nullptr) {
+    fprintf(stderr, "script: can't open %s\n", path);
+    exit(2);
+  }
+
+  char line[128];
+  uint32_t line_number = 0;
+  bool has_end = false;
+  while (fgets(line, sizeof(line), file) != nullptr) {
+    line_number++;
+    unsigned long time_ms;
+    char command[16], name[8];
+    unsigned value = 0;
+    if (line[0] == '#' || line[0] == '\n') {
+      continue;
+    }
+
+    int fields = sscanf(line, "%lu %15s %7s %u", &time_ms, command, name, &value);
+    uint pin = 0;
+    uint64_t time_us = time_ms * 1000;
+    if (fields >= 2 && strcmp(command, "end") == 0) {
+      add_script_event(time_us, SCRIPT_END, 0, 0);
+      has_end = true;
+    } else if (fields >= 3 && parse_pin(name, &pin) && strcmp(command, "press") == 0) {
+      add_script_event(time_us, SCRIPT_PRESS, pin, 0);
+    } else if (fields >= 3 && parse_pin(name, &pin) && strcmp(command, "release") == 0) {
+      add_script_event(time_us, SCRIPT_RELEASE, pin, 0);
+    } else if (fields >= 3 && parse_pin(name, &pin) && strcmp(command, "click") == 0) {
+      add_script_event(time_us, SCRIPT_PRESS, pin, 0);
+      add_script_event(time_us + HAL_CLICK_US, SCRIPT_RELEASE, pin, 0);
+    } else if (fields == 4 && parse_pin(name, &pin) && strcmp(command, "joy") == 0) {
+      add_script_event(time_us, SCRIPT_JOY, pin, value);
+    } else if (fields >= 3 && strcmp(command, "serial") == 0) {
+      for (const char* c = name; *c != '\0'; c++) {
+        add_script_event(time_us, SCRIPT_SERIAL, 0, (uint8_t)*c);
+      }
+    } else if (fields >= 3 && strcmp(command, "send") == 0) {
+      char path[sizeof(line)];
+      sscanf(line, "%*u %*s %127s", path);
+      add_script_file(time_us, path);
+    } else {
+      fprintf(stderr, "script:%lu: can't parse '%s'\n", (unsigned long)line_number, line);
+      exit(2);
+    }
+  }
+  fclose(file);
+
+  if (!has_end) {
+    uint64_t last_us = script_count > 0 ? script[script_count - 1].time_us : 0;
+    add_script_event(last_us + HAL_DEFAULT_END_US, SCRIPT_END, 0, 0);
+  }
+}
+
+static void load_flash(const char* path) {
+  flash_file = fopen(path, "r+b");
+  if (flash_file != nullptr) {
+    size_t length = fread(flash_store, 1, sizeof(flash_store), flash_file);
+    if (length != sizeof(flash_store)) {
+      fprintf(stderr, "flash: %s is not %d bytes\n", path, HAL_FLASH_STORE_SIZE);
+      exit(2);
+    }
+    return;
+  }
+
+  // a new file starts out erased, like a blank chip
+  flash_file = fopen(path, "w+b");
+  if (flash_file == nullptr) {
+    fprintf(stderr, "flash: can't open %s\n", path);
+    exit(2);
+  }
+  fwrite(flash_store, 1, sizeof(flash_store), flash_file);
+  fflush(flash_file);
+}
+
+// RIFF sizes are patched in once the run ends
+static void write_wav_header() {
+  const uint32_t data_size = audio_samples;
+  const uint32_t header[] = {
+    0x46464952, 36 + data_size, 0x45564157, // "RIFF", size, "WAVE"
+    0x20746D66, 16, 1 | (1 << 16), // "fmt ", size, PCM, mono
+    audio_sample_rate, audio_sample_rate, 1 | (8 << 16), // byte rate, block align, bits
+    0x61746164, data_size // "data", size
+  };
+  fseek(audio_file, 0, SEEK_SET);
+  fwrite(header, 1, sizeof(header), audio_file);
+  fseek(audio_file, 0, SEEK_END);
+}
+
+static void play_audio_buffer() {
+  static uint16_t samples[HAL_AUDIO_BUFFER];
+  uint8_t levels[HAL_AUDIO_BUFFER];
+  audio_fill(samples, HAL_AUDIO_BUFFER);
+  for (uint i = 0; i < HAL_AUDIO_BUFFER; i++) {
+    levels[i] = samples[i];
+  }
+  fwrite(levels, 1, sizeof(levels), audio_file);
+  audio_samples += HAL_AUDIO_BUFFER;
+  audio_done_us = audio_start_us + (audio_samples + HAL_AUDIO_BUFFER) * 1000000 / audio_sample_rate;
+}
+
+static void save_oled() {
+  FILE* file = fopen(oled_path, "w");
+  if (file == nullptr) {
+    fprintf(stderr, "oled: can't open %s\n", oled_path);
+    return;
+  }
+  fprintf(file, "P1\n%d %d\n", SSD1306_WIDTH, SSD1306_PAGES * 8);
+  for (uint y = 0; y < SSD1306_PAGES * 8; y++) {
+    for (uint x = 0; x < SSD1306_WIDTH; x++) {
+      fputc(ssd1306_on && (ssd1306_ram[y / 8][x] >> (y % 8) & 1) ? '1' : '0', file);
+    }
+    fputc('\n', file);
+  }
+  fclose(file);
+}
+
+static uint ssd1306_arguments(const uint8_t command) {
+  switch (command) {
+  case 0x21: // column range
+  case 0x22: // page range
+    return 2;
+  case 0x20: case 0x81: case 0x8D: case 0xA8: case 0xD3: case 0xD5: case 0xD9: case 0xDA: case 0xDB:
+    return 1;
+  default:
+    return 0;
+  }
+}
+
+static void ssd1306_command_byte(const uint8_t byte) {
+  ssd1306_command[ssd1306_command_length++] = byte;
+  if (ssd1306_command_length <= ssd1306_arguments(ssd1306_command[0])) {
+    return;
+  }
+  ssd1306_command_length = 0;
+  if (ssd1306_command[0] == 0x21 || ssd1306_command[0] == 0x22) {
+    uint8_t* range = ssd1306_command[0] == 0x21 ? ssd1306_columns : ssd1306_pages;
+    range[0] = ssd1306_command[1];
+    range[1] = ssd1306_command[2];
+    ssd1306_column = ssd1306_columns[0];
+    ssd1306_page = ssd1306_pages[0];
+  } else if (ssd1306_command[0] == 0xAE || ssd1306_command[0] == 0xAF) {
+    ssd1306_on = ssd1306_command[0] == 0xAF;
+  }
+}
+
+// Horizontal addressing mode only, the one Oled.cpp sets up
+static void ssd1306_data_byte(const uint8_t byte) {
+  ssd1306_ram[ssd1306_page % SSD1306_PAGES][ssd1306_column % SSD1306_WIDTH] = byte;
+  if (ssd1306_column++ == ssd1306_columns[1]) {
+    ssd1306_column = ssd1306_columns[0];
+    ssd1306_page = ssd1306_page == ssd1306_pages[1] ? ssd1306_pages[0] : ssd1306_page + 1;
+  }
+}
+
+// A control byte before every byte (Co set) or before the rest of the write,
+// D/C picks commands or display data
+static void ssd1306_write(const uint8_t* data, uint length) {
+  uint i = 0;
+  while (i < length) {
+    const uint8_t control = data[i++];
+    const uint end = (control & 0x80) && i < length ? i + 1 : length;
+    for (; i < end; i++) {
+      if (control & 0x40) {
+        ssd1306_data_byte(data[i]);
+      } else {
+        ssd1306_command_byte(data[i]);
+      }
+    }
+  }
+}
+
+static void save_flash(uint32_t offset, uint32_t length) {
+  if (flash_file == nullptr) {
+    return;
+  }
+  fseek(flash_file, offset, SEEK_SET);
+  fwrite(flash_store + offset, 1, length, flash_file);
+  fflush(flash_file);
+}
+
+void hal_init() {
+  for (uint pin = 0; pin < HAL_GPIO_COUNT; pin++) {
+    gpio_levels[pin] = true;
+  }
+  for (uint input = 0; input < HAL_ADC_INPUTS; input++) {
+    adc_values[input] = 2048; // joystick centred
+  }
+
+  const char* script_path = getenv("MEMORY_GAME_SCRIPT");
+  if (script_path != nullptr) {
+    load_script(script_path);
+  } else {
+    add_script_event(HAL_DEFAULT_END_US, SCRIPT_END, 0, 0);
+  }
+
+  const char* trace_path = getenv("MEMORY_GAME_TRACE");
+  if (trace_path != nullptr) {
+    trace_file = fopen(trace_path, "wb");
+  }
+
+  oled_path = getenv("MEMORY_GAME_OLED");
+
+  const char* audio_path = getenv("MEMORY_GAME_AUDIO");
+  if (audio_path != nullptr) {
+    audio_file = fopen(audio_path, "wb");
+  }
+
+  memset(flash_store, 0xFF, sizeof(flash_store));
+  const char* flash_path = getenv("MEMORY_GAME_FLASH");
+  if (flash_path != nullptr) {
+    load_flash(flash_path);
+  }
+}
+
+static void fill_adc_ring() {
+  if (adc_ring == nullptr) {
+    return;
+  }
+  // same order as the round robin: first_input, then the next enabled inputs
+  uint input = adc_first_input;
+  for (uint32_t i = 0; i < adc_ring_size; i++) {
+    adc_ring[i] = adc_values[input];
+    do {
+      input = (input + 1) % HAL_ADC_INPUTS;
+    } while (!(adc_input_mask & (1u << input)));
+  }
+}
+
+static void print_frame() {
+  printf("%10.3f frame %lu:", now_us / 1000.0, (unsigned long)led_frames);
+  for (uint i = 0; i < led_count; i++) {
+    uint8_t g = led_frame[i] >> 24, r = (led_frame[i] >> 16) & 0xFF, b = (led_frame[i] >> 8) & 0xFF;
+    // one letter per pixel from the channels that are lit
+    const char* letters = ".BGCRMYW";
+    putchar(letters[(r ? 4 : 0) | (g ? 2 : 0) | (b ? 1 : 0)]);
+  }
+  putchar('\n');
+}
+
+static void run_script_event(const script_event_t& event) {
+  switch (event.action) {
+  case SCRIPT_PRESS:
+  case SCRIPT_RELEASE:
+    gpio_levels[event.pin] = event.action == SCRIPT_RELEASE; // pull-up, pressed is low
+    if (edge_callbacks[event.pin] != nullptr) {
+      edge_callbacks[event.pin](event.pin);
+      idle = false;
+    }
+    break;
+  case SCRIPT_JOY:
+    adc_values[event.pin - 26] = event.value; // ADC inputs 0..3 are GPIO 26..29
+    fill_adc_ring();
+    break;
+  case SCRIPT_SERIAL:
+    if (serial_head - serial_tail < HAL_SERIAL_SIZE) {
+      serial_input[serial_head++ % HAL_SERIAL_SIZE] = event.value;
+    }
+    break;
+  case SCRIPT_END:
+    printf("%10.3f end: %lu frames\n", now_us / 1000.0, (unsigned long)led_frames);
+    fflush(stdout);
+    if (trace_file != nullptr) {
+      fclose(trace_file);
+    }
+    if (flash_file != nullptr) {
+      fclose(flash_file);
+    }
+    if (audio_file != nullptr && audio_fill != nullptr) {
+      write_wav_header();
+      fclose(audio_file);
+    }
+    if (oled_path != nullptr) {
+      save_oled();
+    }
+    exit(0);
+  }
+}
+
+// Holds the virtual clock back to the wall clock in realtime mode
+static void pace(uint64_t time_us) {
+  if (!realtime_mode) {
+    return;
+  }
+  timespec wake = realtime_start;
+  wake.tv_sec += time_us / 1000000;
+  wake.tv_nsec += (time_us % 1000000) * 1000;
+  if (wake.tv_nsec >= 1000000000) {
+    wake.tv_sec++;
+    wake.tv_nsec -= 1000000000;
+  }
+  clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &wake, nullptr);
+}
+
+// Advances the virtual clock to time_us, firing everything due on the way in order
+static void advance_to(uint64_t time_us) {
+  while (true) {
+    uint64_t next_us = time_us;
+    // periodic index, HAL_MAX_PERIODIC: script, + 1: LED latch, + 2: audio buffer played
+    int source = -1;
+    for (uint8_t i = 0; i < periodic_count && !idle; i++) {
+      if (periodics[i].next_us <= next_us) {
+        next_us = periodics[i].next_us;
+        source = i;
+      }
+    }
+    if (!benchmark_mode && script_next < script_count && script[script_next].time_us <= next_us) {
+      next_us = script[script_next].time_us;
+      source = HAL_MAX_PERIODIC;
+    }
+    if (led_busy && led_done_us <= next_us) {
+      next_us = led_done_us;
+      source = HAL_MAX_PERIODIC + 1;
+    }
+    if (audio_fill != nullptr && audio_done_us <= next_us) {
+      next_us = audio_done_us;
+      source = HAL_MAX_PERIODIC + 2;
+    }
+    if (source < 0) {
+      break;
+    }
+
+    now_us = next_us > now_us ? next_us : now_us;
+    pace(now_us);
+    if (source < HAL_MAX_PERIODIC) {
+      periodics[source].next_us += periodics[source].period_us;
+      periodics[source].callback();
+    } else if (source == HAL_MAX_PERIODIC) {
+      const bool was_idle = idle;
+      run_script_event(script[script_next++]);
+      if (was_idle && !idle) {
+        return; // woken up, hal_idle_until_button() restarts the timers from now
+      }
+    } else if (source == HAL_MAX_PERIODIC + 2) {
+      play_audio_buffer();
+    } else {
+      led_busy = false;
+      led_frames++;
+      if (!benchmark_mode) {
+        print_frame();
+      }
+      if (led_done_callback != nullptr) {
+        led_done_callback();
+      }
+    }
+  }
+  now_us = time_us > now_us ? time_us : now_us;
+  pace(now_us);
+}
+
+uint64_t hal_time_us() {
+  return now_us;
+}
+
+void hal_sleep_until_us(uint64_t time_us) {
+  advance_to(time_us);
+}
+
+uint64_t hal_idle_until_button() {
+  idle = true;
+  while (idle) {
+    // the end of the script exits from here if no button comes
+    advance_to(script_next < script_count ? script[script_next].time_us : now_us);
+  }
+  // restarted timers count their period from the wake up
+  for (uint8_t i = 0; i < periodic_count; i++) {
+    periodics[i].next_us = now_us + periodics[i].period_us;
+  }
+  return now_us;
+}
+
+// Virtual time is the same on every run, the wall clock and the PID aren't
+uint32_t hal_random() {
+  struct timespec now;
+  clock_gettime(CLOCK_REALTIME, &now);
+  return (uint32_t)now.tv_nsec ^ (uint32_t)now.tv_sec ^ ((uint32_t)getpid() << 16);
+}
+
+uint32_t hal_irq_save() {
+  return 0;
+}
+
+void hal_irq_restore(uint32_t state) {
+  (void)state;
+}
+
+uint hal_core_num() {
+  return 0;
+}
+
+bool hal_start_periodic(uint32_t period_us, hal_callback_t callback) {
+  if (periodic_count >= HAL_MAX_PERIODIC) {
+    return false;
+  }
+  periodics[periodic_count++] = {period_us, now_us + period_us, callback};
+  return true;
+}
+
+void hal_gpio_init_button(uint pin) {
+  gpio_levels[pin] = true;
+}
+
+bool hal_gpio_get(uint pin) {
+  return gpio_levels[pin];
+}
+
+void hal_gpio_set_edge_callback(uint pin, hal_pin_callback_t callback) {
+  edge_callbacks[pin] = callback;
+}
+
+void hal_adc_init_pin(uint pin) {
+  (void)pin;
+}
+
+void hal_adc_start_ring(
+  uint32_t input_mask,
+  uint first_input,
+  uint32_t sample_rate,
+  volatile uint16_t* ring,
+  uint ring_bits
+) {
+  (void)sample_rate;
+  adc_input_mask = input_mask;
+  adc_first_input = first_input;
+  adc_ring = ring;
+  adc_ring_size = 1u << ring_bits;
+  fill_adc_ring();
+}
+
+uint32_t hal_adc_ring_write_index() {
+  return 0; // the whole ring is rewritten on every change
+}
+
+void hal_led_init(uint pin, hal_callback_t done) {
+  (void)pin;
+  led_done_callback = done;
+}
+
+void hal_led_write(const uint32_t* words, uint count) {
+  led_count = count < HAL_MAX_LEDS ? count : HAL_MAX_LEDS;
+  memcpy(led_frame, words, led_count * sizeof(uint32_t));
+  led_busy = true;
+  led_done_us = now_us + count * LED_WORD_US + LED_RESET_US;
+}
+
+// Only played with a file to write it to
+void hal_audio_init(uint pin, uint32_t sample_rate, hal_audio_fill_t fill) {
+  (void)pin;
+  if (audio_file == nullptr) {
+    return;
+  }
+  audio_fill = fill;
+  audio_sample_rate = sample_rate;
+  write_wav_header();
+  audio_start_us = now_us;
+  audio_done_us = audio_start_us + HAL_AUDIO_BUFFER * 1000000ull / sample_rate;
+}
+
+void hal_i2c_init(uint sda, uint scl, uint32_t baud) {
+  (void)sda;
+  (void)scl;
+  i2c_baud = baud;
+}
+
+// Takes as long as the bytes would on the bus, the address byte included
+bool hal_i2c_write(uint8_t address, const uint8_t* data, uint length) {
+  (void)address;
+  if (length == 0 || length > HAL_I2C_MAX_WRITE || hal_i2c_busy()) {
+    return false;
+  }
+  ssd1306_write(data, length);
+  i2c_done_us = now_us + (length + 1) * I2C_BYTE_BITS * 1000000ull / i2c_baud;
+  return true;
+}
+
+bool hal_i2c_busy() {
+  return now_us < i2c_done_us;
+}
+
+const uint8_t* hal_flash_store_data() {
+  return flash_store;
+}
+
+// Same rules as the real chip, so misuse shows up in the simulator
+void hal_flash_store_program(uint32_t offset, const uint8_t* data, uint32_t length) {
+  if (offset % HAL_FLASH_PAGE_SIZE != 0 || length % HAL_FLASH_PAGE_SIZE != 0 || offset + length > HAL_FLASH_STORE_SIZE) {
+    fprintf(stderr, "flash: bad program of %lu bytes at %lu\n", (unsigned long)length, (unsigned long)offset);
+    exit(2);
+  }
+  for (uint32_t i = 0; i < length; i++) {
+    flash_store[offset + i] &= data[i]; // NOR flash only clears bits
+  }
+  save_flash(offset, length);
+}
+
+void hal_flash_store_erase(uint32_t offset) {
+  if (offset % HAL_FLASH_SECTOR_SIZE != 0 || offset >= HAL_FLASH_STORE_SIZE) {
+    fprintf(stderr, "flash: bad erase at %lu\n", (unsigned long)offset);
+    exit(2);
+  }
+  memset(flash_store + offset, 0xFF, HAL_FLASH_SECTOR_SIZE);
+  save_flash(offset, HAL_FLASH_SECTOR_SIZE);
+}
+
+int hal_stdio_read() {
+  if (serial_tail == serial_head) {
+    return -1;
+  }
+  return serial_input[serial_tail++ % HAL_SERIAL_SIZE];
+}
+
+void hal_host_benchmark_mode() {
+  benchmark_mode = true;
+}
+
+void hal_host_realtime_mode() {
+  realtime_mode = true;
+  // wall clock zero is virtual time zero
+  clock_gettime(CLOCK_MONOTONIC, &realtime_start);
+  realtime_start.tv_sec -= now_us / 1000000;
+  realtime_start.tv_nsec -= (now_us % 1000000) * 1000;
+  if (realtime_start.tv_nsec < 0) {
+    realtime_start.tv_sec--;
+    realtime_start.tv_nsec += 1000000000;
+  }
+}
+
+void hal_stdio_write(const void* data, uint length) {
+  if (trace_file != nullptr) {
+    fwrite(data, 1, length, trace_file);
+  }
+}
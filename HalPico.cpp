@@ -0,0 +1,415 @@
+#include "Hal.h"
+#include "pico/stdlib.h"
+#include "hardware/pio.h"
+#include "hardware/clocks.h"
+#include "hardware/dma.h"
+#include "hardware/irq.h"
+#include "hardware/adc.h"
+#include "hardware/pwm.h"
+#include "hardware/i2c.h"
+#include "hardware/flash.h"
+#include "pico/rand.h"
+#include "pico/flash.h"
+
+#include "ws2818b.pio.h"
+
+#define HAL_MAX_PERIODIC 4
+#define HAL_GPIO_COUNT 30
+#define LED_WORD_US 30 // 24 bits at 800kHz
+#define LED_FIFO_DEPTH 8 // joined TX FIFO
+#define LED_RESET_US 100 // RESET signal from datasheet
+#define FLASH_STORE_OFFSET (PICO_FLASH_SIZE_BYTES - HAL_FLASH_STORE_SIZE)
+
+static struct repeating_timer periodic_timers[HAL_MAX_PERIODIC];
+static uint32_t periodic_periods[HAL_MAX_PERIODIC];
+static hal_callback_t periodic_callbacks[HAL_MAX_PERIODIC];
+static uint8_t periodic_count = 0;
+
+static volatile bool idle = false;
+static volatile uint64_t idle_wake_time;
+
+static hal_pin_callback_t edge_callbacks[HAL_GPIO_COUNT];
+
+static int adc_dma_channel;
+static int adc_ctrl_channel;
+static uint32_t adc_ring_transfers;
+static volatile uint16_t* adc_ring;
+
+static PIO led_pio;
+static uint led_sm;
+static int led_dma_channel;
+static hal_callback_t led_done_callback;
+
+static int audio_dma_channels[2];
+static uint16_t audio_buffers[2][HAL_AUDIO_BUFFER];
+static int audio_dma_timer = -1;
+static uint32_t audio_sample_rate;
+static hal_audio_fill_t audio_fill;
+
+static i2c_inst_t* i2c_bus;
+static int i2c_dma_channel;
+static uint16_t i2c_words[HAL_I2C_MAX_WRITE]; // IC_DATA_CMD writes, a byte and the STOP flag
+
+void hal_init() {
+  stdio_init_all();
+}
+
+uint64_t hal_time_us() {
+  return time_us_64();
+}
+
+void hal_sleep_until_us(uint64_t time_us) {
+  sleep_until(from_us_since_boot(time_us));
+}
+
+uint32_t hal_random() {
+  return get_rand_32();
+}
+
+uint32_t hal_irq_save() {
+  return save_and_disable_interrupts();
+}
+
+void hal_irq_restore(uint32_t state) {
+  restore_interrupts(state);
+}
+
+uint hal_core_num() {
+  return get_core_num();
+}
+
+// The DMA timer divides the system clock, which idle changes
+static void audio_pace() {
+  if (audio_dma_timer >= 0) {
+    dma_timer_set_fraction(audio_dma_timer, 1, clock_get_hz(clk_sys) / audio_sample_rate);
+  }
+}
+
+static bool periodic_callback(struct repeating_timer* timer) {
+  ((hal_callback_t)timer->user_data)();
+  return true;
+}
+
+bool hal_start_periodic(uint32_t period_us, hal_callback_t callback) {
+  if (periodic_count >= HAL_MAX_PERIODIC) {
+    return false;
+  }
+  periodic_periods[periodic_count] = period_us;
+  periodic_callbacks[periodic_count] = callback;
+  // negative delay: period measured between starts, not from the end of the callback
+  return add_repeating_timer_us(
+    -(int64_t)period_us,
+    periodic_callback,
+    (void*)callback,
+    &periodic_timers[periodic_count++]
+  );
+}
+
+// Sleep rather than dormant: dormant stops the USB clock and the timer, which
+// would drop the serial connection and the time base.
+uint64_t hal_idle_until_button() {
+  for (uint8_t i = 0; i < periodic_count; i++) {
+    cancel_repeating_timer(&periodic_timers[i]);
+  }
+  adc_run(false);
+  const uint32_t sys_khz = clock_get_hz(clk_sys) / 1000;
+  set_sys_clock_48mhz(); // from the USB PLL, which keeps running for USB anyway
+  audio_pace();
+
+  idle_wake_time = 0;
+  idle = true;
+  while (idle) {
+    __wfe(); // interrupts wake it, and the SEV from an edge handled on the other core
+  }
+
+  set_sys_clock_khz(sys_khz, true);
+  audio_pace();
+  adc_run(true);
+  for (uint8_t i = 0; i < periodic_count; i++) {
+    add_repeating_timer_us(
+      -(int64_t)periodic_periods[i],
+      periodic_callback,
+      (void*)periodic_callbacks[i],
+      &periodic_timers[i]
+    );
+  }
+  return idle_wake_time;
+}
+
+void hal_gpio_init_button(uint pin) {
+  gpio_init(pin);
+  gpio_set_dir(pin, GPIO_IN);
+  gpio_pull_up(pin);
+}
+
+bool hal_gpio_get(uint pin) {
+  return gpio_get(pin);
+}
+
+static void gpio_callback(uint gpio, uint32_t events) {
+  if (gpio < HAL_GPIO_COUNT && edge_callbacks[gpio] != nullptr) {
+    edge_callbacks[gpio](gpio);
+  }
+  if (idle) {
+    idle_wake_time = time_us_64();
+    idle = false;
+    __sev();
+  }
+}
+
+void hal_gpio_set_edge_callback(uint pin, hal_pin_callback_t callback) {
+  edge_callbacks[pin] = callback;
+  // the SDK has one GPIO callback per core, gpio_callback dispatches per pin
+  gpio_set_irq_enabled_with_callback(pin, GPIO_IRQ_EDGE_FALL | GPIO_IRQ_EDGE_RISE, true, &gpio_callback);
+}
+
+void hal_adc_init_pin(uint pin) {
+  static bool adc_ready = false;
+  if (!adc_ready) {
+    adc_init();
+    adc_ready = true;
+  }
+  // Make sure GPIO is high-impedance, no pullups etc
+  adc_gpio_init(pin);
+}
+
+void hal_adc_start_ring(
+  uint32_t input_mask,
+  uint first_input,
+  uint32_t sample_rate,
+  volatile uint16_t* ring,
+  uint ring_bits
+) {
+  adc_ring = ring;
+  adc_ring_transfers = 1u << ring_bits;
+
+  adc_select_input(first_input);
+  adc_set_round_robin(input_mask);
+  adc_fifo_setup(true, true, 1, false, false);
+  adc_set_clkdiv(48000000.f / sample_rate - 1); // ADC clock is 48MHz
+
+  adc_dma_channel = dma_claim_unused_channel(true);
+  adc_ctrl_channel = dma_claim_unused_channel(true);
+
+  // the data channel wraps its write address around the ring and chains to
+  // the control channel, which re-arms it every time the ring has been filled
+  dma_channel_config c = dma_channel_get_default_config(adc_dma_channel);
+  channel_config_set_transfer_data_size(&c, DMA_SIZE_16);
+  channel_config_set_read_increment(&c, false);
+  channel_config_set_write_increment(&c, true);
+  channel_config_set_ring(&c, true, ring_bits + 1); // 2 bytes per sample
+  channel_config_set_dreq(&c, DREQ_ADC);
+  channel_config_set_chain_to(&c, adc_ctrl_channel);
+  dma_channel_configure(adc_dma_channel, &c, ring, &adc_hw->fifo, adc_ring_transfers, false);
+
+  dma_channel_config ctrl = dma_channel_get_default_config(adc_ctrl_channel);
+  channel_config_set_transfer_data_size(&ctrl, DMA_SIZE_32);
+  channel_config_set_read_increment(&ctrl, false);
+  channel_config_set_write_increment(&ctrl, false);
+  dma_channel_configure(
+    adc_ctrl_channel,
+    &ctrl,
+    &dma_channel_hw_addr(adc_dma_channel)->al1_transfer_count_trig,
+    &adc_ring_transfers,
+    1,
+    false
+  );
+
+  dma_channel_start(adc_dma_channel);
+  adc_run(true);
+}
+
+uint32_t hal_adc_ring_write_index() {
+  uintptr_t next = (uintptr_t)dma_channel_hw_addr(adc_dma_channel)->write_addr;
+  return (next - (uintptr_t)adc_ring) / sizeof(uint16_t);
+}
+
+static int64_t led_reset_done(alarm_id_t id, void* user_data) {
+  if (led_done_callback != nullptr) {
+    led_done_callback();
+  }
+  return 0;
+}
+
+static void led_dma_irq_handler() {
+  if (!dma_channel_get_irq0_status(led_dma_channel)) {
+    return;
+  }
+  dma_channel_acknowledge_irq0(led_dma_channel);
+
+  // DMA is done once the last word is in the FIFO, let it drain before the RESET gap
+  alarm_id_t alarm = add_alarm_in_us(
+    (LED_FIFO_DEPTH + 1) * LED_WORD_US + LED_RESET_US,
+    led_reset_done,
+    nullptr,
+    true
+  );
+  if (alarm < 0) {
+    led_reset_done(0, nullptr);
+  }
+}
+
+void hal_led_init(uint pin, hal_callback_t done) {
+  led_done_callback = done;
+
+  uint offset = pio_add_program(pio0, &ws2818b_program);
+  led_pio = pio0;
+  int sm = pio_claim_unused_sm(led_pio, false);
+  if (sm < 0) {
+    led_pio = pio1;
+    sm = pio_claim_unused_sm(led_pio, true);
+  }
+  led_sm = sm;
+
+  ws2818b_program_init(led_pio, led_sm, offset, pin, 800000.f);
+
+  led_dma_channel = dma_claim_unused_channel(true);
+  dma_channel_config c = dma_channel_get_default_config(led_dma_channel);
+  channel_config_set_transfer_data_size(&c, DMA_SIZE_32);
+  channel_config_set_read_increment(&c, true);
+  channel_config_set_write_increment(&c, false);
+  channel_config_set_dreq(&c, pio_get_dreq(led_pio, led_sm, true));
+  dma_channel_configure(led_dma_channel, &c, &led_pio->txf[led_sm], nullptr, 0, false);
+
+  dma_channel_set_irq0_enabled(led_dma_channel, true);
+  irq_add_shared_handler(DMA_IRQ_0, led_dma_irq_handler, PICO_SHARED_IRQ_HANDLER_DEFAULT_ORDER_PRIORITY);
+  irq_set_enabled(DMA_IRQ_0, true);
+}
+
+void hal_led_write(const uint32_t* words, uint count) {
+  dma_channel_transfer_from_buffer_now(led_dma_channel, words, count);
+}
+
+static void audio_dma_irq_handler() {
+  for (uint8_t i = 0; i < 2; i++) {
+    if (!dma_channel_get_irq1_status(audio_dma_channels[i])) {
+      continue;
+    }
+    dma_channel_acknowledge_irq1(audio_dma_channels[i]);
+    // rewound without a trigger, the other channel chains back to it
+    dma_channel_set_read_addr(audio_dma_channels[i], audio_buffers[i], false);
+    audio_fill(audio_buffers[i], HAL_AUDIO_BUFFER);
+  }
+}
+
+// Two channels play the buffers in turn, each chaining to the other
+void hal_audio_init(uint pin, uint32_t sample_rate, hal_audio_fill_t fill) {
+  audio_fill = fill;
+  audio_sample_rate = sample_rate;
+
+  gpio_set_function(pin, GPIO_FUNC_PWM);
+  const uint slice = pwm_gpio_to_slice_num(pin);
+  pwm_config config = pwm_get_default_config();
+  pwm_config_set_wrap(&config, HAL_AUDIO_LEVELS - 1);
+  pwm_init(slice, &config, true);
+  pwm_set_gpio_level(pin, 0);
+
+  audio_dma_timer = dma_claim_unused_timer(true);
+  audio_pace();
+  audio_dma_channels[0] = dma_claim_unused_channel(true);
+  audio_dma_channels[1] = dma_claim_unused_channel(true);
+  for (uint8_t i = 0; i < 2; i++) {
+    fill(audio_buffers[i], HAL_AUDIO_BUFFER);
+    dma_channel_config c = dma_channel_get_default_config(audio_dma_channels[i]);
+    // a halfword write shows up in both halves of CC, the level of either channel
+    channel_config_set_transfer_data_size(&c, DMA_SIZE_16);
+    channel_config_set_read_increment(&c, true);
+    channel_config_set_write_increment(&c, false);
+    channel_config_set_dreq(&c, dma_get_timer_dreq(audio_dma_timer));
+    channel_config_set_chain_to(&c, audio_dma_channels[1 - i]);
+    dma_channel_configure(
+      audio_dma_channels[i], &c, &pwm_hw->slice[slice].cc, audio_buffers[i], HAL_AUDIO_BUFFER, false
+    );
+    dma_channel_set_irq1_enabled(audio_dma_channels[i], true);
+  }
+  irq_add_shared_handler(DMA_IRQ_1, audio_dma_irq_handler, PICO_SHARED_IRQ_HANDLER_DEFAULT_ORDER_PRIORITY);
+  irq_set_enabled(DMA_IRQ_1, true);
+  dma_channel_start(audio_dma_channels[0]);
+}
+
+// SDA and SCL pins pick the controller: I2C0 on 0-1, 4-5..., I2C1 on 2-3, 6-7...
+void hal_i2c_init(uint sda, uint scl, uint32_t baud) {
+  i2c_bus = (sda / 2) % 2 == 0 ? i2c0 : i2c1;
+  i2c_init(i2c_bus, baud);
+  gpio_set_function(sda, GPIO_FUNC_I2C);
+  gpio_set_function(scl, GPIO_FUNC_I2C);
+  gpio_pull_up(sda);
+  gpio_pull_up(scl);
+
+  i2c_dma_channel = dma_claim_unused_channel(true);
+  dma_channel_config c = dma_channel_get_default_config(i2c_dma_channel);
+  channel_config_set_transfer_data_size(&c, DMA_SIZE_16);
+  channel_config_set_read_increment(&c, true);
+  channel_config_set_write_increment(&c, false);
+  channel_config_set_dreq(&c, i2c_get_dreq(i2c_bus, true));
+  dma_channel_configure(i2c_dma_channel, &c, &i2c_get_hw(i2c_bus)->data_cmd, i2c_words, 0, false);
+}
+
+bool hal_i2c_write(uint8_t address, const uint8_t* data, uint length) {
+  if (length == 0 || length > HAL_I2C_MAX_WRITE || hal_i2c_busy()) {
+    return false;
+  }
+  i2c_hw_t* hw = i2c_get_hw(i2c_bus);
+  (void)hw->clr_tx_abrt; // a NACK of the last write holds the FIFO flushed until read
+  hw->enable = 0; // the target address only changes while disabled
+  hw->tar = address;
+  hw->enable = 1;
+
+  for (uint i = 0; i < length; i++) {
+    i2c_words[i] = data[i];
+  }
+  i2c_words[length - 1] |= I2C_IC_DATA_CMD_STOP_BITS;
+  dma_channel_transfer_from_buffer_now(i2c_dma_channel, i2c_words, length);
+  return true;
+}
+
+// Until the STOP is on the bus, not just the last byte in the FIFO
+bool hal_i2c_busy() {
+  if (i2c_bus == nullptr) {
+    return false;
+  }
+  const uint32_t status = i2c_get_hw(i2c_bus)->status;
+  return dma_channel_is_busy(i2c_dma_channel) || !(status & I2C_IC_STATUS_TFE_BITS) ||
+    (status & I2C_IC_STATUS_MST_ACTIVITY_BITS);
+}
+
+struct flash_op_t {
+  uint32_t offset;
+  const uint8_t* data;
+  uint32_t length;
+};
+
+static void flash_program_op(void* param) {
+  const flash_op_t* op = (const flash_op_t*)param;
+  flash_range_program(FLASH_STORE_OFFSET + op->offset, op->data, op->length);
+}
+
+static void flash_erase_op(void* param) {
+  const flash_op_t* op = (const flash_op_t*)param;
+  flash_range_erase(FLASH_STORE_OFFSET + op->offset, FLASH_SECTOR_SIZE);
+}
+
+const uint8_t* hal_flash_store_data() {
+  return (const uint8_t*)(XIP_BASE + FLASH_STORE_OFFSET);
+}
+
+// XIP is off while the flash is busy: flash_safe_execute masks interrupts and
+// parks the other core (if it runs) until the operation is done
+void hal_flash_store_program(uint32_t offset, const uint8_t* data, uint32_t length) {
+  flash_op_t op = {offset, data, length};
+  flash_safe_execute(flash_program_op, &op, UINT32_MAX);
+}
+
+void hal_flash_store_erase(uint32_t offset) {
+  flash_op_t op = {offset, nullptr, 0};
+  flash_safe_execute(flash_erase_op, &op, UINT32_MAX);
+}
+
+void hal_stdio_write(const void* data, uint length) {
+  stdio_put_string((const char*)data, length, false, false);
+}
+
+int hal_stdio_read() {
+  int c = getchar_timeout_us(0);
+  return c < 0 ? -1 : c;
+}
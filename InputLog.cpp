@@ -0,0 +1,134 @@
+#include "InputLog.h"
+#include "Trace.h"
+
+#include <string.h>
+
+InputLog::InputLog() :
+  mode(INPUT_LOG_OFF), header(), records(), record_count(0), replay_next(0), last_tick(0) {}
+
+InputLog& InputLog::getInstance() {
+  static InputLog instance;
+  return instance;
+}
+
+// Ticks count from 0 at the start, the caller restarts them with the game
+void InputLog::startRecording(const input_log_mode_t mode, const input_log_header_t& header) {
+  this->mode = mode;
+  this->header = header;
+  this->header.magic = INPUT_LOG_MAGIC;
+  this->header.version = INPUT_LOG_VERSION;
+  record_count = 0;
+  last_tick = 0;
+  if (mode == INPUT_LOG_STREAM) {
+    trace_send(
+      TRACE_INPUT_LOG_START,
+      this->header.version | (this->header.tick_ms << 8),
+      this->header.frames_to_remember | (this->header.brightness << 8)
+    );
+  }
+}
+
+void InputLog::stop() {
+  if (mode == INPUT_LOG_REPLAY) {
+    TRACE_INFO(TRACE_REPLAY_END, 0, last_tick);
+  }
+  mode = INPUT_LOG_OFF;
+}
+
+// Takes a log made elsewhere (a file on the host) in place of the recording
+bool InputLog::load(const uint8_t* data, const uint32_t length) {
+  if (length < sizeof(input_log_header_t)) {
+    return false;
+  }
+  input_log_header_t loaded;
+  memcpy(&loaded, data, sizeof(loaded));
+  if (loaded.magic != INPUT_LOG_MAGIC || loaded.version != INPUT_LOG_VERSION) {
+    return false;
+  }
+  uint32_t count = (length - sizeof(loaded)) / sizeof(input_log_record_t);
+  if (count > INPUT_LOG_RECORDS) {
+    return false;
+  }
+  mode = INPUT_LOG_OFF;
+  header = loaded;
+  memcpy(records, data + sizeof(loaded), count * sizeof(input_log_record_t));
+  record_count = count;
+  return true;
+}
+
+bool InputLog::startReplay() {
+  if (header.magic != INPUT_LOG_MAGIC) {
+    return false; // nothing recorded or loaded yet
+  }
+  mode = INPUT_LOG_REPLAY;
+  replay_next = 0;
+  last_tick = 0;
+  return true;
+}
+
+input_log_mode_t InputLog::getMode() {
+  return mode;
+}
+
+const input_log_header_t& InputLog::getHeader() {
+  return header;
+}
+
+// Sends the RAM log over the trace, in the same records as streaming
+void InputLog::dump() {
+  if (header.magic != INPUT_LOG_MAGIC) {
+    return;
+  }
+  trace_send(
+    TRACE_INPUT_LOG_START,
+    header.version | (header.tick_ms << 8),
+    header.frames_to_remember | (header.brightness << 8)
+  );
+  uint32_t tick = 0;
+  for (uint32_t i = 0; i < record_count; i++) {
+    tick += records[i].ticks;
+    trace_send_at(TRACE_INPUT_LOG, records[i].time_us, records[i].pin | (records[i].value << 8), tick);
+  }
+}
+
+void InputLog::record(const uint32_t tick, const uint8_t pin, const uint8_t value, const uint64_t time_us) {
+  if (mode == INPUT_LOG_STREAM) {
+    trace_send_at(TRACE_INPUT_LOG, (uint32_t)time_us, pin | (value << 8), tick);
+    return;
+  }
+  if (mode != INPUT_LOG_RAM) {
+    return;
+  }
+
+  while (tick - last_tick > UINT16_MAX && record_count < INPUT_LOG_RECORDS) {
+    records[record_count++] = {UINT16_MAX, INPUT_LOG_PIN_GAP, 0, 0};
+    last_tick += UINT16_MAX;
+  }
+  if (record_count >= INPUT_LOG_RECORDS) {
+    mode = INPUT_LOG_OFF; // a replay needs the whole log, a cut one is kept as it is
+    return;
+  }
+  records[record_count++] = {(uint16_t)(tick - last_tick), pin, value, (uint32_t)time_us};
+  last_tick = tick;
+}
+
+// The next record due on tick, the replay ends after the last one
+bool InputLog::next(const uint32_t tick, input_log_record_t* record) {
+  while (mode == INPUT_LOG_REPLAY) {
+    if (replay_next >= record_count) {
+      stop();
+      return false;
+    }
+    const input_log_record_t& next = records[replay_next];
+    if (last_tick + next.ticks != tick) {
+      return false;
+    }
+    replay_next++;
+    last_tick += next.ticks;
+    if (next.pin != INPUT_LOG_PIN_GAP) {
+      *record = next;
+      return true;
+    }
+  }
+  return false;
+}
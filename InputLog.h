@@ -0,0 +1,70 @@
+#ifndef INPUT_LOG_H
+#define INPUT_LOG_H
+
+#include "Hal.h"
+
+// Input the game consumed, by logic tick, for bit-for-bit replays. The game
+// only sees input through InputManager::update() and only sees time as logic
+// ticks (see update_state()), so feeding back the same events on the same
+// ticks from the same settings plays the same game, at any speed.
+//
+// A log is an input_log_header_t followed by input_log_record_t, little
+// endian. Records are kept in RAM, or streamed over the trace as
+// TRACE_INPUT_LOG_START and TRACE_INPUT_LOG records, tools/input_log.py turns
+// a captured trace into a log file.
+#define INPUT_LOG_MAGIC 0x4E49474D // "MGIN"
+#define INPUT_LOG_VERSION 1
+#define INPUT_LOG_RECORDS 1024 // kept in RAM, recording stops once full
+#define INPUT_LOG_PIN_GAP 0xFF // record without input, for gaps over 65535 ticks
+#ifndef INPUT_REPLAY_SPEED
+#define INPUT_REPLAY_SPEED 8 // logic ticks per tick of the recording
+#endif
+
+struct input_log_header_t {
+  uint32_t magic;
+  uint8_t version;
+  uint8_t tick_ms; // logic tick of the recording
+  uint8_t frames_to_remember; // settings when recording started
+  uint8_t brightness;
+};
+
+struct __attribute__((packed)) input_log_record_t {
+  uint16_t ticks; // since the previous record
+  uint8_t pin;
+  uint8_t value; // buttons: pressed, joystick: direction_t
+  uint32_t time_us; // edge time, low 32 bits
+};
+
+enum input_log_mode_t {
+  INPUT_LOG_OFF,
+  INPUT_LOG_RAM,
+  INPUT_LOG_STREAM,
+  INPUT_LOG_REPLAY
+};
+
+class InputLog {
+public:
+  static InputLog& getInstance();
+
+  void startRecording(const input_log_mode_t mode, const input_log_header_t& header);
+  void stop();
+  bool load(const uint8_t* data, const uint32_t length);
+  bool startReplay();
+  input_log_mode_t getMode();
+  const input_log_header_t& getHeader();
+  void dump();
+
+  void record(const uint32_t tick, const uint8_t pin, const uint8_t value, const uint64_t time_us);
+  bool next(const uint32_t tick, input_log_record_t* record);
+private:
+  InputLog();
+
+  input_log_mode_t mode;
+  input_log_header_t header;
+  input_log_record_t records[INPUT_LOG_RECORDS];
+  uint32_t record_count;
+  uint32_t replay_next;
+  uint32_t last_tick; // of the previous record, written or replayed
+};
+
+#endif // INPUT_LOG_H
@@ -1,12 +1,39 @@
 #include "InputManager.h"
 #include "GPIO.h"
+#include "Trace.h"
+#include "Latency.h"
+#include "InputLog.h"
 
-InputManager::InputManager() {
-  btn_A_state = {0, false, BTN_A_PIN, false};
-  btn_B_state = {0, false, BTN_B_PIN, false};
-  sw_state = {0, false, SW_PIN, false};
-  jst_X_state = {0, NEUTRAL, JST_X_PIN, false};
-  jst_Y_state = {0, NEUTRAL, JST_Y_PIN, false};
+InputManager::InputManager() :
+  button_events(), joystick_events(), last_sample_time(0), last_input_time(0), tick_events(), tick_event_count(0), tick_event_next(0),
+  jst_tick_events(), jst_tick_event_count(0), jst_tick_event_next(0), tick(0) {
+  btn_A_state = {0, false, BTN_A_PIN};
+  btn_B_state = {0, false, BTN_B_PIN};
+  sw_state = {0, false, SW_PIN};
+  jst_X_state = {0, NEUTRAL, JST_X_PIN, JST_ADC_INPUT_X, 0, 0};
+  jst_Y_state = {0, NEUTRAL, JST_Y_PIN, JST_ADC_INPUT_Y, 0, 0};
+  startJoystickSampling();
+
+  // presses pull the pin low, releases let it go high again
+  hal_gpio_set_edge_callback(BTN_A_PIN, gpioCallback);
+  hal_gpio_set_edge_callback(BTN_B_PIN, gpioCallback);
+  hal_gpio_set_edge_callback(SW_PIN, gpioCallback);
+}
+
+void InputManager::startJoystickSampling() {
+  for (uint32_t i = 0; i < JST_ADC_RING_SIZE; i++) {
+    adc_ring[i] = (ADC_MAX) / 2;
+  }
+  jst_X_state.filtered = jst_Y_state.filtered = ((ADC_MAX) / 2) << JST_FILTER_SHIFT;
+
+  // first conversion is Y, so even ring slots are Y
+  hal_adc_start_ring(
+    (1u << JST_ADC_INPUT_Y) | (1u << JST_ADC_INPUT_X),
+    JST_ADC_INPUT_Y,
+    JST_ADC_SAMPLE_RATE,
+    adc_ring,
+    JST_ADC_RING_BITS
+  );
 }
 
 InputManager& InputManager::getInstance() {
@@ -14,124 +41,274 @@ InputManager& InputManager::getInstance() {
   return instance;
 }
 
-void InputManager::update() {
-  checkButtonState(&btn_A_state);
-  checkButtonState(&btn_B_state);
-  checkButtonState(&sw_state);
+void InputManager::gpioCallback(uint gpio) {
+  InputManager& input_manager = getInstance();
+  button_state_t* btn_state = input_manager.getButtonState(gpio);
+  if (btn_state != nullptr) {
+    input_manager.checkButtonState(btn_state, hal_time_us());
+  }
+}
+
+void InputManager::sample() {
+  // catches the level a bouncing button settles on after its last ignored edge
+  uint64_t now = hal_time_us();
+  if (last_sample_time != 0) {
+    int64_t jitter = (int64_t)(now - last_sample_time) - INPUT_SAMPLE_PERIOD_US;
+    latency_record(LATENCY_SAMPLE_JITTER, jitter < 0 ? -jitter : jitter);
+  }
+  last_sample_time = now;
+  checkButtonState(&btn_A_state, now);
+  checkButtonState(&btn_B_state, now);
+  checkButtonState(&sw_state, now);
 
+  filterJoysticks();
   checkJoystickState(&jst_X_state);
   checkJoystickState(&jst_Y_state);
+}
+
+// Sampling stopped for an idle sleep, the first sample after it has no
+// period to keep to
+void InputManager::resume() {
+  last_sample_time = 0;
+}
+
+// Drops what was captured so far without a tick, so neither the game nor the
+// log sees it: the press that woke the game up, which a replay never sleeps for
+void InputManager::discard() {
+  button_event_t button_event;
+  joystick_event_t jst_event;
+  while (button_events.pop(button_event)) {
+    last_input_time = button_event.time;
+  }
+  while (joystick_events.pop(jst_event)) {
+    last_input_time = jst_event.time > last_input_time ? jst_event.time : last_input_time;
+  }
+}
 
-  printf("A: %d, B: %d, SW: %d, X: %d, Y: %d\n",
-    btn_A_state.was_pressed,
-    btn_B_state.was_pressed,
-    sw_state.was_pressed,
-    jst_X_state.last_direction,
-    jst_Y_state.last_direction
+void InputManager::update() {
+  tick++;
+  InputLog& input_log = InputLog::getInstance();
+  if (input_log.getMode() == INPUT_LOG_REPLAY) {
+    replayTick();
+    return;
+  }
+
+  tick_event_count = 0;
+  tick_event_next = 0;
+  while (tick_event_count < BTN_TICK_EVENTS && button_events.pop(tick_events[tick_event_count])) {
+    last_input_time = tick_events[tick_event_count].time;
+    tick_event_count++;
+  }
+
+  jst_tick_event_count = 0;
+  jst_tick_event_next = 0;
+  while (jst_tick_event_count < JST_TICK_EVENTS && joystick_events.pop(jst_tick_events[jst_tick_event_count])) {
+    const joystick_event_t& jst_event = jst_tick_events[jst_tick_event_count++];
+    last_input_time = jst_event.time > last_input_time ? jst_event.time : last_input_time;
+  }
+
+  // after what the pins did, stamped with the tick that takes them
+  injected_input_t input;
+  while (tick_event_count < BTN_TICK_EVENTS && jst_tick_event_count < JST_TICK_EVENTS && injected.pop(input)) {
+    const uint64_t now = hal_time_us();
+    if (input.pin == JST_X_PIN || input.pin == JST_Y_PIN) {
+      jst_tick_events[jst_tick_event_count++] = {now, input.pin, (direction_t)input.value};
+    } else {
+      tick_events[tick_event_count++] = {now, input.pin, input.value != 0};
+    }
+    last_input_time = now;
+  }
+
+  if (input_log.getMode() == INPUT_LOG_RAM || input_log.getMode() == INPUT_LOG_STREAM) {
+    for (uint8_t i = 0; i < tick_event_count; i++) {
+      input_log.record(tick, tick_events[i].pin, tick_events[i].pressed, tick_events[i].time);
+    }
+    for (uint8_t i = 0; i < jst_tick_event_count; i++) {
+      input_log.record(tick, jst_tick_events[i].pin, jst_tick_events[i].direction, jst_tick_events[i].time);
+    }
+  }
+
+  TRACE_DEBUG(
+    TRACE_INPUT,
+    btn_A_state.was_pressed | (btn_B_state.was_pressed << 1) | (sw_state.was_pressed << 2),
+    jst_X_state.last_direction | (jst_Y_state.last_direction << 8)
   );
 }
 
-void InputManager::checkButtonState(button_state_t* btn_state) {
-  bool button_pressed = !gpio_get(btn_state->pin);
+// Main loop only, like update()
+bool InputManager::inject(const uint8_t pin, const uint8_t value) {
+  return injected.push({pin, value});
+}
+
+uint32_t InputManager::getInjectRoom() {
+  return INJECTED_QUEUE_SIZE - injected.size();
+}
+
+// Hands out the events logged for this tick in place of the captured ones,
+// which are dropped so that nothing but the log reaches the game
+void InputManager::replayTick() {
+  button_event_t button_event;
+  joystick_event_t jst_event;
+  while (button_events.pop(button_event)) {}
+  while (joystick_events.pop(jst_event)) {}
+  injected_input_t input;
+  while (injected.pop(input)) {}
+
+  tick_event_count = 0;
+  tick_event_next = 0;
+  jst_tick_event_count = 0;
+  jst_tick_event_next = 0;
+
+  input_log_record_t record;
+  while (InputLog::getInstance().next(tick, &record)) {
+    if (record.pin == JST_X_PIN || record.pin == JST_Y_PIN) {
+      if (jst_tick_event_count < JST_TICK_EVENTS) {
+        jst_tick_events[jst_tick_event_count++] = {record.time_us, record.pin, (direction_t)record.value};
+      }
+    } else if (tick_event_count < BTN_TICK_EVENTS) {
+      tick_events[tick_event_count++] = {record.time_us, record.pin, record.value != 0};
+    }
+  }
+}
+
+// Runs from the GPIO interrupt and from sample(), both at the same interrupt
+// priority on the same core, so they never preempt each other.
+void InputManager::checkButtonState(button_state_t* btn_state, uint64_t now) {
+  bool button_pressed = !hal_gpio_get(btn_state->pin);
 
-  btn_state->clicked = false;
   if (
-    button_pressed &&
-    !btn_state->was_pressed &&
-    absolute_time_diff_us(btn_state->last_press_time, get_absolute_time()) > BTN_DEBOUNCE * 1000
+    button_pressed == btn_state->was_pressed ||
+    now - btn_state->last_edge_time <= BTN_DEBOUNCE * 1000
   ) {
-    btn_state->last_press_time = get_absolute_time();
-    btn_state->clicked = true;
+    return;
   }
-
+  btn_state->last_edge_time = now;
   btn_state->was_pressed = button_pressed;
+
+  button_events.push({now, (uint8_t)btn_state->pin, button_pressed});
+}
+
+button_state_t* InputManager::getButtonState(int pin) {
+  switch (pin) {
+  case BTN_A_PIN:
+    return &btn_A_state;
+  case BTN_B_PIN:
+    return &btn_B_state;
+  case SW_PIN:
+    return &sw_state;
+  default:
+    return nullptr;
+  }
+}
+
+// Averages the whole ring (JST_ADC_RING_SIZE / 2 conversions per axis) and
+// feeds it through a one-pole IIR, without waiting on any conversion.
+void InputManager::filterJoysticks() {
+  uint32_t sum_y = 0, sum_x = 0;
+  for (uint32_t i = 0; i < JST_ADC_RING_SIZE; i += 2) {
+    sum_y += adc_ring[i];
+    sum_x += adc_ring[i + 1];
+  }
+
+  uint32_t next = hal_adc_ring_write_index();
+  uint32_t last = (next + JST_ADC_RING_SIZE - 1) % JST_ADC_RING_SIZE;
+  uint32_t before_last = (next + JST_ADC_RING_SIZE - 2) % JST_ADC_RING_SIZE;
+  jst_Y_state.raw = adc_ring[last % 2 == 0 ? last : before_last];
+  jst_X_state.raw = adc_ring[last % 2 == 1 ? last : before_last];
+
+  const uint32_t samples = JST_ADC_RING_SIZE / 2;
+  const uint32_t mean_y = (sum_y << JST_FILTER_SHIFT) / samples;
+  const uint32_t mean_x = (sum_x << JST_FILTER_SHIFT) / samples;
+  jst_Y_state.filtered += ((int32_t)mean_y - (int32_t)jst_Y_state.filtered) >> JST_FILTER_SHIFT;
+  jst_X_state.filtered += ((int32_t)mean_x - (int32_t)jst_X_state.filtered) >> JST_FILTER_SHIFT;
 }
 
 void InputManager::checkJoystickState(joystick_state_t* jst_state) {
-  direction_t direction = getJoystickDirection(jst_state->pin);
+  direction_t direction = getJoystickDirection(jst_state);
+  uint64_t now = hal_time_us();
 
-  jst_state->changed = false;
   if (
     direction != jst_state->last_direction &&
     direction != NEUTRAL &&
-    absolute_time_diff_us(jst_state->last_press_time, get_absolute_time()) > BTN_DEBOUNCE * 1000
+    now - jst_state->last_press_time > BTN_DEBOUNCE * 1000
   ) {
-    jst_state->last_press_time = get_absolute_time();
-    jst_state->changed = true;
+    jst_state->last_press_time = now;
+    joystick_events.push({jst_state->last_press_time, (uint8_t)jst_state->pin, direction});
   }
 
   jst_state->last_direction = direction;
 }
 
-direction_t InputManager::getJoystickDirection(int pin) {
-  switch (pin) {
-  case JST_X_PIN:
-    adc_select_input(1);
-    break;
-  case JST_Y_PIN:
-    adc_select_input(0);
-    break;
-  default:
-    return NEUTRAL;
-    break;
+direction_t InputManager::getJoystickDirection(const joystick_state_t* jst_state) {
+  uint16_t value = jst_state->filtered >> JST_FILTER_SHIFT;
+
+  if (value < JST_THRESHOLD) {
+    return NEG;
+  } else if (value > ADC_MAX - JST_THRESHOLD) {
+    return POS;
   }
-  uint16_t jst_adc_raw = adc_read();
 
-  if (jst_adc_raw < JST_THRESHOLD) {
+  // only fall back to NEUTRAL once the stick is well away from the edge
+  if (jst_state->last_direction == NEG && value < JST_RELEASE_THRESHOLD) {
     return NEG;
-  } else if (jst_adc_raw > ADC_MAX - JST_THRESHOLD) {
+  } else if (jst_state->last_direction == POS && value > ADC_MAX - JST_RELEASE_THRESHOLD) {
     return POS;
   } else {
     return NEUTRAL;
   }
 }
 
-bool InputManager::isButtonPressed(int pin) {
-  switch (pin) {
-  case BTN_A_PIN:
-    return btn_A_state.was_pressed;
-    break;
-  case BTN_B_PIN:
-    return btn_B_state.was_pressed;
-    break;
-  case SW_PIN:
-    return sw_state.was_pressed;
-    break;
-  default:
+bool InputManager::nextButtonEvent(button_event_t* event) {
+  if (tick_event_next >= tick_event_count) {
     return false;
-    break;
   }
+  *event = tick_events[tick_event_next++];
+  return true;
 }
 
-bool InputManager::isButtonClicked(int pin) {
-  switch (pin) {
-  case BTN_A_PIN:
-    return btn_A_state.clicked;
-    break;
-  case BTN_B_PIN:
-    return btn_B_state.clicked;
-    break;
-  case SW_PIN:
-    return sw_state.clicked;
-    break;
-  default:
+bool InputManager::nextJoystickEvent(joystick_event_t* event) {
+  if (jst_tick_event_next >= jst_tick_event_count) {
     return false;
-    break;
   }
+  *event = jst_tick_events[jst_tick_event_next++];
+  return true;
+}
+
+// Edge time of the first press handed out by the last update(), 0 when none
+uint64_t InputManager::getFirstPressTime() {
+  for (uint8_t i = 0; i < tick_event_count; i++) {
+    if (tick_events[i].pressed) {
+      return tick_events[i].time;
+    }
+  }
+  return 0;
+}
+
+uint64_t InputManager::getLastInputTime() {
+  return last_input_time;
+}
+
+uint32_t InputManager::getTick() {
+  return tick;
+}
+
+// Game time starts over with a recording or a replay
+void InputManager::restartTicks() {
+  tick = 0;
 }
 
-bool InputManager::isJoystickXChanged() {
-  return jst_X_state.changed;
+uint16_t InputManager::getJoystickXRaw() {
+  return jst_X_state.raw;
 }
 
-bool InputManager::isJoystickYChanged() {
-  return jst_Y_state.changed;
+uint16_t InputManager::getJoystickYRaw() {
+  return jst_Y_state.raw;
 }
 
-direction_t InputManager::getJoystickXDirection() {
-  return jst_X_state.last_direction;
+uint16_t InputManager::getJoystickXFiltered() {
+  return jst_X_state.filtered >> JST_FILTER_SHIFT;
 }
 
-direction_t InputManager::getJoystickYDirection() {
-  return jst_Y_state.last_direction;
+uint16_t InputManager::getJoystickYFiltered() {
+  return jst_Y_state.filtered >> JST_FILTER_SHIFT;
 }
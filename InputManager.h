@@ -2,19 +2,39 @@
 #define INPUT_MANAGER_H
 
 #include <stdio.h>
-#include "pico/stdlib.h"
-#include "hardware/adc.h"
+#include "Hal.h"
+#include "RingBuffer.h"
 
+#ifndef INPUT_SAMPLE_PERIOD_US
+#define INPUT_SAMPLE_PERIOD_US 1000
+#endif
 #define BTN_DEBOUNCE 100
 #define ADC_BITS 12
 #define ADC_MAX (1 << ADC_BITS) - 1 // 12-bit ADC
-#define JST_THRESHOLD 300
+#define JST_THRESHOLD 300 // enter NEG/POS this close to the rails
+#define JST_RELEASE_THRESHOLD 700 // leave NEG/POS only past this, hysteresis
+#define JST_ADC_INPUT_Y 0 // GPIO 26
+#define JST_ADC_INPUT_X 1 // GPIO 27
+#define JST_ADC_SAMPLE_RATE 8000 // conversions per second, shared by both axes
+#define JST_ADC_RING_BITS 7
+#define JST_ADC_RING_SIZE (1 << JST_ADC_RING_BITS) // samples, interleaved Y, X, Y, X...
+#define JST_FILTER_SHIFT 2 // IIR weight 1/4, also the fractional bits of filtered
+#define BTN_EVENT_QUEUE_SIZE 32 // power of two
+#define BTN_TICK_EVENTS 16 // events handed to the game per update()
+#define JST_EVENT_QUEUE_SIZE 16 // power of two
+#define JST_TICK_EVENTS 8 // events handed to the game per update()
+#define INJECTED_QUEUE_SIZE 16 // power of two, inputs from inject() waiting for update()
 
 struct button_state_t {
-  absolute_time_t last_press_time;
-  bool was_pressed;
+  uint64_t last_edge_time; // us
+  volatile bool was_pressed;
   int pin;
-  bool clicked;
+};
+
+struct button_event_t {
+  uint64_t time; // us
+  uint8_t pin;
+  bool pressed;
 };
 
 enum direction_t {
@@ -24,36 +44,89 @@ enum direction_t {
 };
 
 struct joystick_state_t {
-  absolute_time_t last_press_time;
+  uint64_t last_press_time; // us
   direction_t last_direction;
   int pin;
-  bool changed;
+  uint adc_input;
+  uint16_t raw; // most recent conversion
+  uint32_t filtered; // oversampled and IIR filtered, JST_FILTER_SHIFT fractional bits
+};
+
+struct joystick_event_t {
+  uint64_t time; // us
+  uint8_t pin;
+  direction_t direction;
 };
 
+// Input that didn't come from the pins, see inject()
+struct injected_input_t {
+  uint8_t pin;
+  uint8_t value; // buttons: pressed, joystick: direction_t
+};
+
+// Buttons are captured by GPIO edge interrupts into a timestamped event queue,
+// sample() queues joystick steps and is meant to run much faster than the
+// game logic. update() drains everything captured since the previous update()
+// and hands it to the getters below, so no event is lost between logic ticks.
+// Producers (the GPIO interrupt and sample()) must not preempt each other;
+// the queues are the only state shared with the consumer, so sampling may run
+// on the other core. inject() queues input from the main loop for the next
+// update(), as if it happened then. Every update() is a logic tick: what it hands out goes
+// into the InputLog when recording, and comes from it when replaying.
 class InputManager {
 public:
+  void sample();
   void update();
+  void resume();
+  void discard();
+  bool inject(const uint8_t pin, const uint8_t value);
+  uint32_t getInjectRoom();
   
-  bool isButtonPressed(int pin);
-  bool isButtonClicked(int pin);
-  bool isJoystickXChanged();
-  bool isJoystickYChanged();
-  direction_t getJoystickXDirection();
-  direction_t getJoystickYDirection();
+  bool nextButtonEvent(button_event_t* event);
+  bool nextJoystickEvent(joystick_event_t* event);
+  uint64_t getFirstPressTime();
+  uint64_t getLastInputTime();
+  uint32_t getTick();
+  void restartTicks();
+  uint16_t getJoystickXRaw();
+  uint16_t getJoystickYRaw();
+  uint16_t getJoystickXFiltered();
+  uint16_t getJoystickYFiltered();
 
   static InputManager& getInstance();
 private:
   InputManager();
 
-  void checkButtonState(button_state_t* btn_state);
+  static void gpioCallback(uint gpio);
+  button_state_t* getButtonState(int pin);
+  void checkButtonState(button_state_t* btn_state, uint64_t now);
+  void startJoystickSampling();
+  void filterJoysticks();
   void checkJoystickState(joystick_state_t* jst_state);
-  direction_t getJoystickDirection(int pin);
+  void replayTick();
+  direction_t getJoystickDirection(const joystick_state_t* jst_state);
 
   button_state_t btn_A_state;
   button_state_t btn_B_state;
   button_state_t sw_state;
   joystick_state_t jst_X_state;
   joystick_state_t jst_Y_state;
+
+  // free-running round-robin conversions, written by the HAL (DMA on the board)
+  alignas(JST_ADC_RING_SIZE * sizeof(uint16_t)) volatile uint16_t adc_ring[JST_ADC_RING_SIZE];
+
+  RingBuffer<button_event_t, BTN_EVENT_QUEUE_SIZE> button_events;
+  RingBuffer<joystick_event_t, JST_EVENT_QUEUE_SIZE> joystick_events;
+  RingBuffer<injected_input_t, INJECTED_QUEUE_SIZE> injected;
+  uint64_t last_sample_time; // us
+  uint64_t last_input_time; // us, newest button or joystick event handed out
+  button_event_t tick_events[BTN_TICK_EVENTS];
+  uint8_t tick_event_count;
+  uint8_t tick_event_next;
+  joystick_event_t jst_tick_events[JST_TICK_EVENTS];
+  uint8_t jst_tick_event_count;
+  uint8_t jst_tick_event_next;
+  uint32_t tick; // update() calls since restartTicks()
 };
 
 #endif // INPUT_MANAGER_H
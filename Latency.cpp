@@ -0,0 +1,46 @@
+#include "Latency.h"
+#include "Trace.h"
+
+histogram_t latency_histograms[LATENCY_IDS_COUNT];
+
+#if DUAL_CORE_MODE
+histogram_t latency_core1_histograms[2][LATENCY_IDS_COUNT];
+std::atomic<uint8_t> latency_core1_bank(0);
+std::atomic<bool> latency_core1_busy(false);
+#endif
+
+void latency_dump() {
+#if DUAL_CORE_MODE
+  // a record that started before the swap ends within a few instructions,
+  // one that starts after it goes to the new bank
+  const uint8_t bank = latency_core1_bank.load();
+  latency_core1_bank.store(bank ^ 1);
+  while (latency_core1_busy.load()) {}
+#endif
+  for (uint8_t id = 0; id < LATENCY_IDS_COUNT; id++) {
+    // copied with interrupts off, so a sample lands either in this dump or the next
+    uint32_t irq_state = hal_irq_save();
+    histogram_t histogram = latency_histograms[id];
+    latency_histograms[id] = {};
+    hal_irq_restore(irq_state);
+#if DUAL_CORE_MODE
+    histogram_t& core1 = latency_core1_histograms[bank][id];
+    for (uint8_t b = 0; b < LATENCY_BUCKETS; b++) {
+      histogram.buckets[b] += core1.buckets[b];
+    }
+    histogram.max = core1.max > histogram.max ? core1.max : histogram.max;
+    core1 = {};
+#endif
+
+    if (histogram.max == 0 && histogram.buckets[0] == 0) {
+      continue; // a max of 0 leaves samples in bucket 0 only
+    }
+
+    trace_send(TRACE_LATENCY_MAX, id, histogram.max);
+    for (uint8_t b = 0; b < LATENCY_BUCKETS; b++) {
+      if (histogram.buckets[b] > 0) {
+        trace_send(TRACE_LATENCY_BUCKET, id | (b << 8), histogram.buckets[b]);
+      }
+    }
+  }
+}
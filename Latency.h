@@ -0,0 +1,70 @@
+#ifndef LATENCY_H
+#define LATENCY_H
+
+#include "Hal.h"
+#include "DualCore.h"
+
+#include <atomic>
+
+// Always-on latency histograms with fixed log2 buckets: bucket 0 counts 0 us,
+// bucket b counts [2^(b-1), 2^b) us and the last one everything longer.
+// Recording is a count-leading-zeros and two stores, cheap enough for
+// interrupt handlers. latency_dump() sends them over the trace stream.
+#define LATENCY_BUCKETS 20
+
+// Keep in sync with LATENCIES in tools/trace_decode.py
+enum latency_id_t {
+  LATENCY_INIT_STATE,      // one update_state() that handled events, in state_t order
+  LATENCY_SETTING_STATE,
+  LATENCY_FRAMER_STATE,
+  LATENCY_REMEMBER_STATE,
+  LATENCY_MEMORIZER_STATE,
+  LATENCY_FINAL_STATE,
+  LATENCY_PEER_STATE,
+  LATENCY_RENDER,          // one render() call
+  LATENCY_SAMPLE_JITTER,   // input sample() start, away from its period
+  LATENCY_INPUT_TO_PHOTON, // button edge to the end of the first frame sent after it
+  LATENCY_WAKE_TO_FRAME,   // edge that ends an idle sleep to the end of the next frame
+  LATENCY_IDS_COUNT
+};
+
+struct histogram_t {
+  uint32_t buckets[LATENCY_BUCKETS];
+  uint32_t max; // us
+};
+
+extern histogram_t latency_histograms[LATENCY_IDS_COUNT];
+
+#if DUAL_CORE_MODE
+// Core 1 records into a bank of its own, latency_dump() moves it to the other
+// one and waits for the busy flag before taking the old bank. Its records
+// never nest: sample() runs with interrupts off, the LED callback in one.
+extern histogram_t latency_core1_histograms[2][LATENCY_IDS_COUNT];
+extern std::atomic<uint8_t> latency_core1_bank;
+extern std::atomic<bool> latency_core1_busy;
+#endif
+
+static inline void latency_add(histogram_t& histogram, const uint32_t us) {
+  uint32_t bucket = us == 0 ? 0 : 32 - __builtin_clz(us);
+  histogram.buckets[bucket < LATENCY_BUCKETS ? bucket : LATENCY_BUCKETS - 1]++;
+  if (us > histogram.max) {
+    histogram.max = us;
+  }
+}
+
+static inline void latency_record(const latency_id_t id, const uint32_t us) {
+#if DUAL_CORE_MODE
+  if (hal_core_num() == 1) {
+    latency_core1_busy.store(true);
+    latency_add(latency_core1_histograms[latency_core1_bank.load()][id], us);
+    latency_core1_busy.store(false);
+    return;
+  }
+#endif
+  latency_add(latency_histograms[id], us);
+}
+
+// Sends every histogram with samples as trace records, then clears them all
+void latency_dump();
+
+#endif // LATENCY_H
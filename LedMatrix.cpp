@@ -1,242 +1,232 @@
 #include "LedMatrix.h"
 
-LedMatrix* LedMatrix::instance = nullptr;
+#include <string.h>
 
-LedMatrix& LedMatrix::getInstance() {
+template <uint32_t W, uint32_t H, template <uint32_t, uint32_t> class Layout>
+LedMatrix<W, H, Layout>* LedMatrix<W, H, Layout>::instance = nullptr;
+
+template <uint32_t W, uint32_t H, template <uint32_t, uint32_t> class Layout>
+LedMatrix<W, H, Layout>& LedMatrix<W, H, Layout>::getInstance() {
   if (instance == nullptr) {
     new LedMatrix();
   }
   return *instance;
 }
 
-LedMatrix::LedMatrix() : led_matrix(), led_matrix_pio(), sm(), was_changed(false) {
+template <uint32_t W, uint32_t H, template <uint32_t, uint32_t> class Layout>
+LedMatrix<W, H, Layout>::LedMatrix() :
+  led_matrix(), front_frame(), resend(true), frames_issued(0), frames_skipped(0),
+  led_words(), render_busy(false), render_done_callback(nullptr),
+  levels(), brightness(LED_DEFAULT_BRIGHTNESS), dithering(false), dither_phase(0)
+#if DUAL_CORE_MODE
+  , frame_queue(), pending_frame(), has_pending_frame(false)
+#endif
+  {
   instance = this;
-  uint offset = pio_add_program(pio0, &ws2818b_program);
-  led_matrix_pio = pio0;
-
-  sm = pio_claim_unused_sm(led_matrix_pio, false);
-  if (sm < 0) {  // sm is an unsigned int, therefore it can't be negative (how does this work?)
-    led_matrix_pio = pio1;
-    sm = pio_claim_unused_sm(led_matrix_pio, true);
-  }
-
-  ws2818b_program_init(led_matrix_pio, sm, offset, LED_MATRIX_PIN, 800000.f);
+  hal_led_init(LED_MATRIX_PIN, renderDone);
 
+  updateLevels();
   clear();
 }
 
-void LedMatrix::setLED(const uint index_x, const uint index_y, const COLORS color) {
-  if (index_x >= LED_COUNT_X || index_y >= LED_COUNT_Y) {
+template <uint32_t W, uint32_t H, template <uint32_t, uint32_t> class Layout>
+void LedMatrix<W, H, Layout>::setLED(const uint index_x, const uint index_y, const COLORS color) {
+  if (index_x >= W || index_y >= H) {
     return;
   }
-  was_changed = true;
-
-  led_matrix[index_x][index_y] = color;
+  led_matrix.set(index_x, index_y, color);
 }
 
-void LedMatrix::setLEDs(const COLORS leds[LED_COUNT_X][LED_COUNT_Y]) {
-  for (uint8_t i = 0; i < LED_COUNT_X; i++)
-    for (uint8_t j = 0; j < LED_COUNT_Y; j++)
-      setLED(i, j, leds[i][j]);
+template <uint32_t W, uint32_t H, template <uint32_t, uint32_t> class Layout>
+void LedMatrix<W, H, Layout>::setLEDs(const frame_type& leds) {
+  led_matrix = leds;
 }
 
-void LedMatrix::clear() {
-  for (uint8_t i = 0; i < LED_COUNT_X; i++)
-    for (uint8_t j = 0; j < LED_COUNT_Y; j++)
-      setLED(i, j, BLACK);
+template <uint32_t W, uint32_t H, template <uint32_t, uint32_t> class Layout>
+void LedMatrix<W, H, Layout>::clear() {
+  led_matrix.clear();
 }
 
-void LedMatrix::clear(COLORS leds[LED_COUNT_X][LED_COUNT_Y]) {
-  for (uint8_t i = 0; i < LED_COUNT_X; i++)
-    for (uint8_t j = 0; j < LED_COUNT_Y; j++)
-      leds[i][j] = BLACK;
+template <uint32_t W, uint32_t H, template <uint32_t, uint32_t> class Layout>
+void LedMatrix<W, H, Layout>::clear(frame_type& leds) {
+  leds.clear();
 }
 
-void LedMatrix::render() {
-  if (!was_changed) {
+template <uint32_t W, uint32_t H, template <uint32_t, uint32_t> class Layout>
+void LedMatrix<W, H, Layout>::render() {
+  if (!resend && !dithering && led_matrix == front_frame) {
+    frames_skipped++;
     return;
   }
-  was_changed = false;
-  for (uint8_t j = 0; j < LED_COUNT_Y; j++) {
-    for (int8_t i = 0; i < LED_COUNT_X; i++) {
-      pio_sm_put_blocking(
-        led_matrix_pio,
-        sm,
-        COLORS_ARRAY[led_matrix[j % 2 == 0 ? LED_COUNT_X - 1 - i : i][j]].G
-      );
-      pio_sm_put_blocking(
-        led_matrix_pio,
-        sm,
-        COLORS_ARRAY[led_matrix[j % 2 == 0 ? LED_COUNT_X - 1 - i : i][j]].R
-      );
-      pio_sm_put_blocking(
-        led_matrix_pio,
-        sm,
-        COLORS_ARRAY[led_matrix[j % 2 == 0 ? LED_COUNT_X - 1 - i : i][j]].B
-      );
-    }
+#if DUAL_CORE_MODE
+  if (!frame_queue.push(led_matrix)) {
+    return; // core 1 is behind, front_frame is left alone and the next call retries
+  }
+  dual_core_doorbell();
+#else
+  if (render_busy) {
+    return; // a frame still in flight, the next call sends the newest one
+  }
+  transmit(led_matrix);
+#endif
+  front_frame = led_matrix;
+  resend = false;
+  frames_issued++;
+}
+
+// Core 1 side of render() in DUAL_CORE_MODE: only the newest queued frame is sent.
+template <uint32_t W, uint32_t H, template <uint32_t, uint32_t> class Layout>
+void LedMatrix<W, H, Layout>::service() {
+#if DUAL_CORE_MODE
+  frame_type frame;
+  while (frame_queue.pop(frame)) {
+    pending_frame = frame;
+    has_pending_frame = true;
+  }
+  if (has_pending_frame && !render_busy) {
+    has_pending_frame = false;
+    transmit(pending_frame);
   }
-  sleep_us(100); // wait for 100us, RESET signal from datasheet
+#endif
 }
 
-// setLED(0, 4, color); setLED(1, 4, color); setLED(2, 4, color); setLED(3, 4, color); setLED(4, 4, color);
-// setLED(0, 3, color); setLED(1, 3, color); setLED(2, 3, color); setLED(3, 3, color); setLED(4, 3, color);
-// setLED(0, 2, color); setLED(1, 2, color); setLED(2, 2, color); setLED(3, 2, color); setLED(4, 2, color);
-// setLED(0, 1, color); setLED(1, 1, color); setLED(2, 1, color); setLED(3, 1, color); setLED(4, 1, color);
-// setLED(0, 0, color); setLED(1, 0, color); setLED(2, 0, color); setLED(3, 0, color); setLED(4, 0, color);
+template <uint32_t W, uint32_t H, template <uint32_t, uint32_t> class Layout>
+void LedMatrix<W, H, Layout>::transmit(const frame_type& leds) {
+  render_busy = true;
+  encode(leds);
+  hal_led_write(led_words, W * H);
+}
 
+template <uint32_t W, uint32_t H, template <uint32_t, uint32_t> class Layout>
+bool LedMatrix<W, H, Layout>::isRenderDone() {
+  return !render_busy;
+}
 
-void LedMatrix::setSmile(COLORS color) {
-  clear();
-                       setLED(1, 4, color);                      setLED(3, 4, color);
-                       setLED(1, 3, color);                      setLED(3, 3, color);
+template <uint32_t W, uint32_t H, template <uint32_t, uint32_t> class Layout>
+void LedMatrix<W, H, Layout>::setRenderDoneCallback(render_done_callback_t callback) {
+  render_done_callback = callback;
+}
 
-  setLED(0, 1, color);                                                                setLED(4, 1, color);
-  setLED(0, 0, color); setLED(1, 0, color); setLED(2, 0, color); setLED(3, 0, color); setLED(4, 0, color);
+// Adds a per-pixel, per-frame offset below one level and keeps the integer
+// part, so a level of 3.25 is sent as 4 on one frame out of four.
+template <uint32_t W, uint32_t H, template <uint32_t, uint32_t> class Layout>
+void LedMatrix<W, H, Layout>::encode(const frame_type& leds) {
+  const uint32_t dither_mask = (1 << LED_DITHER_BITS) - 1;
+  for (uint32_t w = 0; w < W * H; w++) {
+    const led_level_t& level = levels[leds.getIndex(WIRE_MAP.pixel[w])];
+    // centred in its step, the offset averages to half a level
+    uint32_t offset = (DITHER_SEQUENCE[(dither_phase + w * 7) & dither_mask] << (8 - LED_DITHER_BITS)) |
+      (1 << (7 - LED_DITHER_BITS));
+    uint32_t gr = ((level.gr + (offset | (offset << 16))) >> 8) & 0x00FF00FF;
+    uint32_t b = (level.b + offset) >> 8;
+    // shifted out MSB first from bit 31, G then R then B (see ws2818b_program_init)
+    led_words[w] = ((gr & 0xFF) << 24) | (gr & 0xFF0000) | (b << 8);
+  }
+  dither_phase++;
+}
+
+template <uint32_t W, uint32_t H, template <uint32_t, uint32_t> class Layout>
+void LedMatrix<W, H, Layout>::updateLevels() {
+  // 0xFF00 * brightness / 255 is exactly brightness.0, full colours never dither
+  uint32_t fractions = 0;
+  for (uint8_t c = 0; c < COLORS_COUNT; c++) {
+    const rgb_t& rgb = COLORS_ARRAY[c];
+    uint32_t r = GAMMA_LUT[rgb.R] * brightness / 255;
+    uint32_t g = GAMMA_LUT[rgb.G] * brightness / 255;
+    uint32_t b = GAMMA_LUT[rgb.B] * brightness / 255;
+    levels[c] = {g | (r << 16), b};
+    fractions |= (r | g | b) & 0xFF;
+  }
+  dithering = fractions != 0;
 }
 
-void LedMatrix::setCheck(COLORS color) {
-  clear();
-                                                                                      setLED(4, 3, color);
-                                                                 setLED(3, 2, color);
-  setLED(0, 1, color);                      setLED(2, 1, color);
-                       setLED(1, 0, color);
+// In DUAL_CORE_MODE core 1 may encode a frame with half updated levels, which
+// only shows for that one frame.
+template <uint32_t W, uint32_t H, template <uint32_t, uint32_t> class Layout>
+void LedMatrix<W, H, Layout>::setBrightness(const uint8_t level) {
+  if (level == brightness) {
+    return;
+  }
+  brightness = level;
+  updateLevels();
+  resend = true;
 }
 
-void LedMatrix::setCross(COLORS color) {
-  clear();
-  setLED(0, 4, color);                                                                setLED(4, 4, color);
-                       setLED(1, 3, color);                      setLED(3, 3, color);
-                                            setLED(2, 2, color);
-                       setLED(1, 1, color);                      setLED(3, 1, color);
-  setLED(0, 0, color);                                                                setLED(4, 0, color);
-}
-
-void LedMatrix::setNumber(const uint8_t number, COLORS color) {
-  switch (number) {
-    case 0:
-      setNumberZero(color);
-      break;
-    case 1:
-      setNumberOne(color);
-      break;
-    case 2:
-      setNumberTwo(color);
-      break;
-    case 3:
-      setNumberThree(color);
-      break;
-    case 4:
-      setNumberFour(color);
-      break;
-    case 5:
-      setNumberFive(color);
-      break;
-    case 6:
-      setNumberSix(color);
-      break;
-    case 7:
-      setNumberSeven(color);
-      break;
-    case 8:
-      setNumberEight(color);
-      break;
-    case 9:
-      setNumberNine(color);
-      break;
-    default:
-      break;
+template <uint32_t W, uint32_t H, template <uint32_t, uint32_t> class Layout>
+uint8_t LedMatrix<W, H, Layout>::getBrightness() {
+  return brightness;
+}
+
+template <uint32_t W, uint32_t H, template <uint32_t, uint32_t> class Layout>
+void LedMatrix<W, H, Layout>::renderDone() {
+  instance->render_busy = false;
+  if (instance->render_done_callback != nullptr) {
+    instance->render_done_callback();
   }
 }
 
-void LedMatrix::setNumberZero(COLORS color) {
-    clear();
-    setLED(1, 4, color); setLED(2, 4, color); setLED(3, 4, color);
-    setLED(1, 3, color);                      setLED(3, 3, color);
-    setLED(1, 2, color);                      setLED(3, 2, color);
-    setLED(1, 1, color);                      setLED(3, 1, color);
-    setLED(1, 0, color); setLED(2, 0, color); setLED(3, 0, color);
+template <uint32_t W, uint32_t H, template <uint32_t, uint32_t> class Layout>
+void LedMatrix<W, H, Layout>::drawGlyph(const GLYPHS id, const COLORS color) {
+  // centred on panels bigger than a glyph
+  led_matrix.fillGlyph(
+    GLYPH_FONT[id],
+    GLYPH_WIDTH,
+    GLYPH_HEIGHT,
+    (W - GLYPH_WIDTH) / 2,
+    (H - GLYPH_HEIGHT) / 2,
+    color
+  );
 }
 
-void LedMatrix::setNumberOne(COLORS color) {
-  clear();
-                       setLED(2, 4, color);
-  setLED(1, 3, color); setLED(2, 3, color);
-                       setLED(2, 2, color);
-                       setLED(2, 1, color);
-  setLED(1, 0, color); setLED(2, 0, color); setLED(3, 0, color);
-  render();
+template <uint32_t W, uint32_t H, template <uint32_t, uint32_t> class Layout>
+void LedMatrix<W, H, Layout>::setNumber(const uint8_t number, COLORS color) {
+  if (number > 9) {
+    return;
+  }
+  drawGlyph((GLYPHS)(GLYPH_ZERO + number), color);
+}
+
+// Text that fits is centred. Longer text scrolls one column to the left per
+// step, from its start at the left edge, and comes back in from the right
+// once its end has left the panel.
+template <uint32_t W, uint32_t H, template <uint32_t, uint32_t> class Layout>
+void LedMatrix<W, H, Layout>::drawText(const char* text, const uint32_t step, const COLORS color) {
+  led_matrix.clear();
+  const uint32_t width = textWidth(text);
+  const uint32_t y = (H - FONT_HEIGHT) / 2;
+  const uint32_t left = width <= W ? (W - width) / 2 : 0;
+
+  for (uint32_t x = left; x < W; x++) {
+    const uint32_t column = width <= W ? x - left : (step + x) % (width + W);
+    const uint32_t in_glyph = column % FONT_ADVANCE;
+    if (column >= width || in_glyph >= FONT_WIDTH) {
+      continue; // past the end or between two characters
+    }
+    const uint16_t glyph = FONT[font_index(text[column / FONT_ADVANCE])];
+    const uint32_t bits = (glyph >> (in_glyph * FONT_HEIGHT)) & FONT_COLUMN_MASK;
+    for (uint32_t gy = 0; gy < FONT_HEIGHT; gy++) {
+      if ((bits >> gy) & 1) {
+        led_matrix.set(x, y + gy, color);
+      }
+    }
+  }
 }
 
-void LedMatrix::setNumberTwo(COLORS color) {
-  clear();
-  setLED(1, 4, color); setLED(2, 4, color); setLED(3, 4, color);
-                                            setLED(3, 3, color);
-  setLED(1, 2, color); setLED(2, 2, color); setLED(3, 2, color);
-  setLED(1, 1, color);
-  setLED(1, 0, color); setLED(2, 0, color); setLED(3, 0, color);
-  render();
-}
-
-void LedMatrix::setNumberThree(COLORS color) {
-    clear();
-    setLED(1, 4, color); setLED(2, 4, color); setLED(3, 4, color);
-                                              setLED(3, 3, color);
-    setLED(1, 2, color); setLED(2, 2, color); setLED(3, 2, color);
-                                              setLED(3, 1, color);
-    setLED(1, 0, color); setLED(2, 0, color); setLED(3, 0, color);
-}
-
-void LedMatrix::setNumberFour(COLORS color) {
-    clear();
-    setLED(1, 4, color);                      setLED(3, 4, color);
-    setLED(1, 3, color);                      setLED(3, 3, color);
-    setLED(1, 2, color); setLED(2, 2, color); setLED(3, 2, color);
-                                              setLED(3, 1, color);
-                                              setLED(3, 0, color);
-}
-
-void LedMatrix::setNumberFive(COLORS color) {
-    clear();
-    setLED(1, 4, color); setLED(2, 4, color); setLED(3, 4, color);
-    setLED(1, 3, color);
-    setLED(1, 2, color); setLED(2, 2, color); setLED(3, 2, color);
-                                              setLED(3, 1, color);
-    setLED(1, 0, color); setLED(2, 0, color); setLED(3, 0, color);
-}
-
-void LedMatrix::setNumberSix(COLORS color) {
-    clear();
-    setLED(1, 4, color); setLED(2, 4, color); setLED(3, 4, color);
-    setLED(1, 3, color);
-    setLED(1, 2, color); setLED(2, 2, color); setLED(3, 2, color);
-    setLED(1, 1, color);                      setLED(3, 1, color);
-    setLED(1, 0, color); setLED(2, 0, color); setLED(3, 0, color);
-}
-
-void LedMatrix::setNumberSeven(COLORS color) {
-    clear();
-    setLED(1, 4, color); setLED(2, 4, color); setLED(3, 4, color);
-                                              setLED(3, 3, color);
-                                              setLED(3, 2, color);
-                                              setLED(3, 1, color);
-                                              setLED(3, 0, color);
-}
-
-void LedMatrix::setNumberEight(COLORS color) {
-    clear();
-    setLED(1, 4, color); setLED(2, 4, color); setLED(3, 4, color);
-    setLED(1, 3, color);                      setLED(3, 3, color);
-    setLED(1, 2, color); setLED(2, 2, color); setLED(3, 2, color);
-    setLED(1, 1, color);                      setLED(3, 1, color);
-    setLED(1, 0, color); setLED(2, 0, color); setLED(3, 0, color);
-}
-
-void LedMatrix::setNumberNine(COLORS color) {
-    clear();
-    setLED(1, 4, color); setLED(2, 4, color); setLED(3, 4, color);
-    setLED(1, 3, color);                      setLED(3, 3, color);
-    setLED(1, 2, color); setLED(2, 2, color); setLED(3, 2, color);
-                                              setLED(3, 1, color);
-    setLED(1, 0, color); setLED(2, 0, color); setLED(3, 0, color);
+// Columns text takes up on the panel
+template <uint32_t W, uint32_t H, template <uint32_t, uint32_t> class Layout>
+uint32_t LedMatrix<W, H, Layout>::textWidth(const char* text) {
+  const uint32_t length = strlen(text);
+  return length == 0 ? 0 : length * FONT_ADVANCE - FONT_SPACING;
+}
+
+template <uint32_t W, uint32_t H, template <uint32_t, uint32_t> class Layout>
+uint32_t LedMatrix<W, H, Layout>::getFramesIssued() {
+  return frames_issued;
+}
+
+template <uint32_t W, uint32_t H, template <uint32_t, uint32_t> class Layout>
+uint32_t LedMatrix<W, H, Layout>::getFramesSkipped() {
+  return frames_skipped;
 }
+
+template class LedMatrix<LED_COUNT_X, LED_COUNT_Y, LED_LAYOUT>;
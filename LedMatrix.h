@@ -2,77 +2,163 @@
 #define LED_MATRIX_H
 
 #include <stdio.h>
-#include "pico/stdlib.h"
-#include "hardware/pio.h"
-#include "hardware/clocks.h"
+#include "Hal.h"
+#include "Frame.h"
+#include "Glyphs.h"
+#include "Gamma.h"
+#include "DualCore.h"
+#include "RingBuffer.h"
 
-#include "ws2818b.pio.h"
-
-#define LED_COUNT_X 5
-#define LED_COUNT_Y 5
-#define LED_COUNT (LED_X_COUNT * LED_Y_COUNT)
 #define LED_MATRIX_PIN 7
+#define LED_FRAME_QUEUE_SIZE 4 // power of two, frames handed from core 0 to core 1
+#ifndef LED_DEFAULT_BRIGHTNESS
+#define LED_DEFAULT_BRIGHTNESS 16 // full colours come out at 16 of 255, as before gamma
+#endif
+#define LED_DITHER_BITS 4 // temporal dithering, fraction bits of a level spread over 16 frames
+
+// Wiring layouts: wire(x, y) is the position of LED (x, y) along the data line.
+// Serpentine layouts reverse every other line, starting with the first one
+// (the BitDogLab 5x5 panel is SerpentineRows).
+template <uint32_t W, uint32_t H>
+struct ProgressiveRows {
+  static constexpr uint32_t wire(const uint32_t x, const uint32_t y) {
+    return y * W + x;
+  }
+};
+
+template <uint32_t W, uint32_t H>
+struct SerpentineRows {
+  static constexpr uint32_t wire(const uint32_t x, const uint32_t y) {
+    return y * W + (y % 2 == 0 ? W - 1 - x : x);
+  }
+};
+
+template <uint32_t W, uint32_t H>
+struct ProgressiveColumns {
+  static constexpr uint32_t wire(const uint32_t x, const uint32_t y) {
+    return x * H + y;
+  }
+};
+
+template <uint32_t W, uint32_t H>
+struct SerpentineColumns {
+  static constexpr uint32_t wire(const uint32_t x, const uint32_t y) {
+    return x * H + (x % 2 == 0 ? H - 1 - y : y);
+  }
+};
+
+#ifndef LED_LAYOUT
+#define LED_LAYOUT SerpentineRows
+#endif
+
+// Pixel index (y * W + x) for every position along the data line, built at compile time
+template <uint32_t W, uint32_t H, template <uint32_t, uint32_t> class Layout>
+struct WireMap {
+  uint16_t pixel[W * H];
+
+  constexpr WireMap() : pixel() {
+    for (uint32_t y = 0; y < H; y++)
+      for (uint32_t x = 0; x < W; x++)
+        pixel[Layout<W, H>::wire(x, y)] = y * W + x;
+  }
+};
 
 struct rgb_t {
   uint8_t R, G, B;
 };
 
-enum COLORS {
-  BLACK,
-  WHITE,
-  RED,
-  GREEN,
-  BLUE,
-  YELLOW,
-  CYAN,
-  MAGENTA,
-  COLORS_COUNT
+// Drive levels of a colour after gamma and brightness, in 8.8 fixed point.
+// Two channels share gr (G in the low half, R in the high half) so the
+// dithering offset is added to both at once, each half keeps clear of the
+// other as levels stay at or below 0xFF00.
+struct led_level_t {
+  uint32_t gr;
+  uint32_t b;
 };
 
+typedef void (*render_done_callback_t)();
+
+// Perceived levels, brightness and gamma are applied on the way out
 const rgb_t COLORS_ARRAY[COLORS_COUNT] = {
   {0, 0, 0},
-  {16, 16, 16},
-  {16, 0, 0},
-  {0, 16, 0},
-  {0, 0, 16},
-  {16, 16, 0},
-  {0, 16, 16},
-  {16, 0, 16}
+  {255, 255, 255},
+  {255, 0, 0},
+  {0, 255, 0},
+  {0, 0, 255},
+  {255, 255, 0},
+  {0, 255, 255},
+  {255, 0, 255}
+};
+
+// Bit-reversed counter: any 2^k consecutive frames get evenly spread offsets
+const uint8_t DITHER_SEQUENCE[1 << LED_DITHER_BITS] = {
+  0, 8, 4, 12, 2, 10, 6, 14, 1, 9, 5, 13, 3, 11, 7, 15
 };
 
+template <uint32_t W, uint32_t H, template <uint32_t, uint32_t> class Layout>
 class LedMatrix {
 public:
+  typedef Frame<W, H> frame_type;
+
   static LedMatrix& getInstance();
   void setLED(const uint index_x, const uint index_y, const COLORS color);
-  void setLEDs(const COLORS leds[LED_COUNT_X][LED_COUNT_Y]);
+  void setLEDs(const frame_type& leds);
   void render();
+  bool isRenderDone();
+  void setRenderDoneCallback(render_done_callback_t callback);
+  void service();
   void clear();
-  static void clear(COLORS leds[LED_COUNT_X][LED_COUNT_Y]);
+  static void clear(frame_type& leds);
   
-  void setSmile(COLORS color);
-  void setCheck(COLORS color);
-  void setCross(COLORS color);
-
+  void drawGlyph(const GLYPHS id, const COLORS color);
   void setNumber(const uint8_t number, COLORS color);
-  void setNumberOne(COLORS color);
-  void setNumberTwo(COLORS color);
-  void setNumberThree(COLORS color);
-  void setNumberFour(COLORS color);
-  void setNumberFive(COLORS color);
-  void setNumberSix(COLORS color);
-  void setNumberSeven(COLORS color);
-  void setNumberEight(COLORS color);
-  void setNumberNine(COLORS color);
-  void setNumberZero(COLORS color);
+  void drawText(const char* text, const uint32_t step, const COLORS color);
+  static uint32_t textWidth(const char* text);
+
+  void setBrightness(const uint8_t level);
+  uint8_t getBrightness();
+
+  uint32_t getFramesIssued();
+  uint32_t getFramesSkipped();
 private:
   LedMatrix();
-  COLORS led_matrix[LED_COUNT_X][LED_COUNT_Y];
-  PIO led_matrix_pio;
-  uint sm;
+  // the game draws into the back buffer, render() commits it to the front
+  // buffer (what the LEDs show) only when the two differ
+  frame_type led_matrix;
+  frame_type front_frame;
 
-  bool was_changed;
+  bool resend; // the LEDs may not match front_frame, send even if unchanged
+  uint32_t frames_issued;
+  uint32_t frames_skipped;
+
+  void transmit(const frame_type& leds);
+  void encode(const frame_type& leds);
+  void updateLevels();
+  static void renderDone();
+
+  static constexpr WireMap<W, H, Layout> WIRE_MAP = {};
+
+  // GRB words in wire order, read by the HAL while a frame is in flight
+  uint32_t led_words[W * H];
+  volatile bool render_busy;
+  render_done_callback_t render_done_callback;
+
+  led_level_t levels[COLORS_COUNT];
+  uint8_t brightness;
+  bool dithering; // some level has a fraction, frames are sent even when unchanged
+  uint8_t dither_phase;
+
+#if DUAL_CORE_MODE
+  // render() queues committed frames here, service() on core 1 sends them
+  RingBuffer<frame_type, LED_FRAME_QUEUE_SIZE> frame_queue;
+  frame_type pending_frame;
+  bool has_pending_frame;
+#endif
 
   static LedMatrix* instance;
 };
 
+// The panel the game runs on, instantiated in LedMatrix.cpp
+typedef LedMatrix<LED_COUNT_X, LED_COUNT_Y, LED_LAYOUT> led_matrix_t;
+
 #endif // LED_MATRIX_H
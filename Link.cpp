@@ -0,0 +1,215 @@
+#include "Link.h"
+#include "Trace.h"
+
+#include <string.h>
+
+static_assert(MAX_FRAMES + 1 <= LINK_WINDOW, "a whole turn must fit in the window");
+static_assert((LINK_WINDOW & (LINK_WINDOW - 1)) == 0 && LINK_WINDOW < 256, "sequence numbers wrap at 256");
+
+Link::Link() :
+  up(false), session(0), outbox(), tx_base(0), tx_next(0), last_transmit_time(0),
+  peer_heard(false), peer_session(0), rx_next(0), rx_frames(), rx_count(0),
+  rx_turn(INIT_STATE), turn_pending(false) {
+  up = transport_open();
+  // tells a restarted board from the one before it, the clock can't: it
+  // reads the same early in every boot, and always 0 on the host
+  session = (uint8_t)hal_random();
+}
+
+Link& Link::getInstance() {
+  static Link instance;
+  return instance;
+}
+
+bool Link::isUp() {
+  return up;
+}
+
+// Queues the frames and the turn as one run of messages, false when the
+// window doesn't have room for all of them
+bool Link::sendTurn(const state_t turn, const frame_t* frames, const uint8_t count) {
+  if (!up || (uint8_t)(tx_next - tx_base) + count + 1 > LINK_WINDOW) {
+    return false;
+  }
+  for (uint8_t i = 0; i < count; i++) {
+    queueFrame(i, frames);
+  }
+  const uint8_t payload[2] = {(uint8_t)turn, count};
+  queue(LINK_TURN, payload, sizeof(payload));
+  TRACE_INFO(TRACE_LINK_TURN, turn, count);
+  return true;
+}
+
+// The state the peer handed over, if it did
+bool Link::peekTurn(state_t* turn) {
+  *turn = rx_turn;
+  return turn_pending;
+}
+
+// Copies out the frames of the pending turn and returns how many
+uint8_t Link::takeTurn(frame_t* frames) {
+  turn_pending = false;
+  for (uint8_t i = 0; i < rx_count; i++) {
+    frames[i] = rx_frames[i];
+  }
+  return rx_count;
+}
+
+// Picks the shortest of the bitplanes and a delta from the previous frame or
+// from a blank one
+bool Link::queueFrame(const uint8_t index, const frame_t* frames) {
+  uint8_t payload[sizeof(link_packet_t::data) - sizeof(link_header_t)];
+  const frame_t& frame = frames[index];
+  frame_t blank;
+  blank.clear();
+  const frame_t& base = index > 0 ? frames[index - 1] : blank;
+
+  frame_mask_t from_blank = frame.diff(blank);
+  frame_mask_t from_base = frame.diff(base);
+  const bool use_base = from_base.count() < from_blank.count();
+  const frame_mask_t& changes = use_base ? from_base : from_blank;
+  const uint32_t delta_length = 2 + 2 * changes.count();
+
+  payload[0] = index;
+  if (delta_length >= 1 + sizeof(frame_t)) {
+    memcpy(payload + 1, frame.planes, sizeof(frame_t));
+    return queue(LINK_FRAME, payload, 1 + sizeof(frame_t));
+  }
+
+  payload[1] = use_base ? index - 1 : LINK_BASE_BLANK;
+  uint8_t* change = payload + 2;
+  for (uint32_t i = 0; i < LED_COUNT; i++) {
+    if (changes.test(i % LED_COUNT_X, i / LED_COUNT_X)) {
+      const uint16_t entry = (i << FRAME_PLANES) | frame.getIndex(i);
+      *change++ = entry & 0xFF;
+      *change++ = entry >> 8;
+    }
+  }
+  return queue(LINK_DELTA, payload, delta_length);
+}
+
+bool Link::queue(const uint8_t type, const uint8_t* payload, const uint8_t length) {
+  if ((uint8_t)(tx_next - tx_base) >= LINK_WINDOW) {
+    return false;
+  }
+  link_packet_t& packet = outbox[tx_next % LINK_WINDOW];
+  const link_header_t header = {type, session, tx_next, rx_next};
+  memcpy(packet.data, &header, sizeof(header));
+  memcpy(packet.data + sizeof(header), payload, length);
+  packet.length = sizeof(header) + length;
+  tx_next++;
+  transmit(packet);
+  return true;
+}
+
+void Link::transmit(link_packet_t& packet) {
+  ((link_header_t*)packet.data)->ack = rx_next; // the newest acknowledgement rides along
+  transport_send(packet.data, packet.length);
+  last_transmit_time = hal_time_us();
+}
+
+void Link::sendAck() {
+  const link_header_t header = {LINK_ACK, session, tx_base, rx_next};
+  transport_send((const uint8_t*)&header, sizeof(header));
+}
+
+// Takes in whatever arrived and sends everything not acknowledged again once
+// the peer has been quiet for LINK_RESEND_MS
+void Link::service() {
+  if (!up) {
+    return;
+  }
+  uint8_t data[TRANSPORT_MTU];
+  int32_t length;
+  while ((length = transport_receive(data, sizeof(data))) >= 0) {
+    receive(data, length);
+  }
+
+  const uint8_t pending = tx_next - tx_base;
+  if (pending > 0 && hal_time_us() - last_transmit_time >= LINK_RESEND_MS * 1000) {
+    TRACE_INFO(TRACE_LINK_RESEND, tx_base, pending);
+    for (uint8_t seq = tx_base; seq != tx_next; seq++) {
+      transmit(outbox[seq % LINK_WINDOW]);
+    }
+  }
+}
+
+void Link::receive(const uint8_t* data, const uint32_t length) {
+  link_header_t header;
+  if (length < sizeof(header)) {
+    return;
+  }
+  memcpy(&header, data, sizeof(header));
+  if (header.type >= LINK_TYPES) {
+    return;
+  }
+
+  // every session numbers its messages from 0, whichever of them arrives
+  // first. A peer that restarted lost what was sent to it, and expects this
+  // board to start from 0 too.
+  if (!peer_heard || header.session != peer_session) {
+    if (peer_heard) {
+      tx_base = 0;
+      tx_next = 0;
+    }
+    peer_heard = true;
+    peer_session = header.session;
+    rx_next = 0;
+  }
+
+  if ((uint8_t)(header.ack - tx_base) <= (uint8_t)(tx_next - tx_base)) {
+    tx_base = header.ack;
+  }
+  if (header.type == LINK_ACK) {
+    return;
+  }
+
+  if (header.seq == rx_next) {
+    rx_next++;
+    deliver(header.type, data + sizeof(header), length - sizeof(header));
+  }
+  sendAck();
+}
+
+void Link::deliver(const uint8_t type, const uint8_t* payload, const uint32_t length) {
+  if (length < 2) {
+    return;
+  }
+  const uint8_t index = payload[0];
+
+  switch (type) {
+  case LINK_FRAME:
+    if (index < MAX_FRAMES && length >= 1 + sizeof(frame_t)) {
+      memcpy(rx_frames[index].planes, payload + 1, sizeof(frame_t));
+    }
+    break;
+  case LINK_DELTA: {
+    const uint8_t base = payload[1];
+    if (index >= MAX_FRAMES || (base != LINK_BASE_BLANK && base >= MAX_FRAMES)) {
+      break;
+    }
+    frame_t& frame = rx_frames[index];
+    if (base == LINK_BASE_BLANK) {
+      frame.clear();
+    } else {
+      frame = rx_frames[base];
+    }
+    for (uint32_t i = 2; i + 1 < length; i += 2) {
+      const uint16_t entry = payload[i] | (payload[i + 1] << 8);
+      const uint32_t pixel = entry >> FRAME_PLANES;
+      if (pixel < LED_COUNT) {
+        frame.set(pixel % LED_COUNT_X, pixel / LED_COUNT_X, (COLORS)(entry & ((1 << FRAME_PLANES) - 1)));
+      }
+    }
+    break;
+  }
+  case LINK_TURN:
+    rx_turn = (state_t)payload[0];
+    rx_count = payload[1] <= MAX_FRAMES ? payload[1] : MAX_FRAMES;
+    turn_pending = true;
+    TRACE_INFO(TRACE_LINK_TURN, rx_turn | 0x100, rx_count);
+    break;
+  default:
+    break;
+  }
+}
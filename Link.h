@@ -0,0 +1,82 @@
+#ifndef LINK_H
+#define LINK_H
+
+#include "Transport.h"
+#include "Game.h"
+
+// Two-player protocol over a Transport.h datagram link. The board that frames
+// hands its frames and the turn to the other one, which plays REMEMBER_STATE
+// and MEMORIZER_STATE and hands its own frames and the turn back, both boards
+// then show FINAL_STATE. A turn waits on the receiving board until its game
+// can take it.
+//
+// Every datagram starts with a link_header_t. Messages (everything but
+// LINK_ACK) are delivered in order: the peer acknowledges the next sequence
+// number it expects on every datagram, anything older than that is dropped and
+// everything not acknowledged is sent again after LINK_RESEND_MS. Frames go
+// out as their packed bitplanes or, when shorter, as the pixels that differ
+// from the previous frame or from a blank one. Both ends are little endian.
+#define LINK_WINDOW 64 // messages not acknowledged yet, power of two below 128
+#define LINK_RESEND_MS 100
+#define LINK_BASE_BLANK 0xFF // LINK_DELTA base of a blank frame
+
+enum link_type_t {
+  LINK_ACK,   // header only
+  LINK_FRAME, // index, frame_t bitplanes
+  LINK_DELTA, // index, base frame index, then pixel << FRAME_PLANES | colour, 16 bits each
+  LINK_TURN,  // state_t for the peer, frames sent before it
+  LINK_TYPES
+};
+
+struct link_header_t {
+  uint8_t type;
+  uint8_t session; // picked on open, a new one restarts the sequence numbers
+  uint8_t seq; // this message, or the oldest one not acknowledged in a LINK_ACK
+  uint8_t ack; // next message expected from the peer
+};
+
+struct link_packet_t {
+  uint8_t length;
+  uint8_t data[sizeof(link_header_t) + 2 + sizeof(frame_t)];
+};
+
+static_assert(sizeof(link_packet_t::data) <= TRANSPORT_MTU, "a frame must fit in one datagram");
+static_assert(LED_COUNT < (1 << (16 - FRAME_PLANES)), "LINK_DELTA pixel indices take 13 bits");
+
+class Link {
+public:
+  static Link& getInstance();
+
+  bool isUp();
+  bool sendTurn(const state_t turn, const frame_t* frames, const uint8_t count);
+  bool peekTurn(state_t* turn);
+  uint8_t takeTurn(frame_t* frames);
+  void service();
+private:
+  Link();
+
+  bool queueFrame(const uint8_t index, const frame_t* frames);
+  bool queue(const uint8_t type, const uint8_t* payload, const uint8_t length);
+  void transmit(link_packet_t& packet);
+  void sendAck();
+  void receive(const uint8_t* data, const uint32_t length);
+  void deliver(const uint8_t type, const uint8_t* payload, const uint32_t length);
+
+  bool up;
+  uint8_t session;
+  link_packet_t outbox[LINK_WINDOW];
+  uint8_t tx_base; // oldest message not acknowledged
+  uint8_t tx_next;
+  uint64_t last_transmit_time; // us
+  bool peer_heard;
+  uint8_t peer_session;
+  uint8_t rx_next; // next message expected
+
+  // frames of the turn being received, handed to the game with it
+  frame_t rx_frames[MAX_FRAMES];
+  uint8_t rx_count;
+  state_t rx_turn;
+  bool turn_pending;
+};
+
+#endif // LINK_H
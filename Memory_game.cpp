@@ -1,356 +1,313 @@
 #include <stdio.h>
-#include "pico/stdlib.h"
-#include "hardware/pio.h"
-#include "hardware/clocks.h"
-#include "hardware/adc.h"
+#include <stdlib.h>
+#include "Hal.h"
 #include "GPIO.h"
 #include "InputManager.h"
 #include "LedMatrix.h"
-
-#define UPDATE_STATE_DELAY 250
-#define MAX_FRAMES 9
-#define MIN_FRAMES 1
-
-#define abs(x) ((x) < 0 ? -(x) : (x))
-
-enum state_t {
-  INIT_STATE,
-  SETTING_STATE,
-  FRAMER_STATE,
-  REMEMBER_STATE,
-  MEMORIZER_STATE,
-  FINAL_STATE
-};
-enum COMPARE_STATE {
-    CORRECT,
-    PLAYER,
-    COMPARE,
-    COMPARE_STATE_COUNT
-  };
-state_t current_state = INIT_STATE;
-uint8_t frames_to_remember = MIN_FRAMES;
-uint8_t current_index_x = 0, current_index_y = 0, current_frame = 0;
-COMPARE_STATE show_frames_comp = CORRECT;
-
-COLORS frames_framer[MAX_FRAMES][LED_COUNT_X][LED_COUNT_Y];
-COLORS frames_memorizer[MAX_FRAMES][LED_COUNT_X][LED_COUNT_Y];
-
-void init_state();
-void setting_state();
-void frame_state();
-void remember_state();
-void game_state();
-void final_state();
-bool update_state();
-
-bool compare_frames(
-  COLORS frame1[LED_COUNT_X][LED_COUNT_Y],
-  COLORS frame2[LED_COUNT_X][LED_COUNT_Y]
-);
-void navigate_leds();
-void switch_frames();
-void set_frames(COLORS current_frames[MAX_FRAMES][LED_COUNT_X][LED_COUNT_Y]);
+#include "Scheduler.h"
+#include "DualCore.h"
+#include "Trace.h"
+#include "FlashStore.h"
+#include "Game.h"
+#include "Latency.h"
+#include "Link.h"
+#include "InputLog.h"
+#include "Audio.h"
+#include "Oled.h"
+#include "StatusView.h"
+#include "Command.h"
+
+#ifndef LOGIC_PERIOD_MS
+#define LOGIC_PERIOD_MS 20
+#endif
+#ifndef RENDER_REFRESH_HZ
+#define RENDER_REFRESH_HZ 60
+#endif
+#define TRACE_DRAIN_PERIOD_MS 10
+#define STORE_SERVICE_PERIOD_MS 100
+#define CONSOLE_PERIOD_MS 50
+#define LINK_PERIOD_MS 10
+#define OLED_PERIOD_MS 10 // a dirty page goes out in about 3 ms at 400 kHz
+#define CONSOLE_DUMP_LATENCY 'h' // dumps and clears the latency histograms
+#define CONSOLE_RECORD 'r' // starts a new game, recording its input into RAM
+#define CONSOLE_RECORD_STREAM 's' // the same, streaming it over the trace
+#define CONSOLE_STOP 'x' // stops recording or replaying
+#define CONSOLE_DUMP_LOG 'd' // sends the input recorded into RAM over the trace
+#define CONSOLE_REPLAY 'p' // replays the input in RAM from a new game
+#define PHOTON_TIMEOUT_MS 100 // a press that changes nothing on the LEDs for this long is dropped
+#ifndef IDLE_TIMEOUT_MS
+#define IDLE_TIMEOUT_MS 60000 // no input for this long blanks the LEDs and sleeps
+#endif
+#define IDLE_BLANK_POLL_US 1000
+#define IDLE_BLANK_TRIES 100 // bounds the wait for the blank frame to latch
+
+// Input-to-photon: the edge of the oldest press not on the LEDs yet, then
+// the same edge once a frame carrying it is on its way
+uint64_t photon_press_time = 0;
+volatile uint64_t photon_frame_press_time = 0;
+
+uint64_t wake_time = 0; // us, edge that ended the last idle sleep
+volatile uint64_t wake_frame_time = 0; // the same, until the next frame has latched
+
+bool replaying = false; // the logic task runs INPUT_REPLAY_SPEED times faster
+
+void input_sample_callback();
+void logic_task();
+void render_task();
+void trace_task();
+void store_task();
+void console_task();
+void link_task();
+void oled_task();
+void idle();
+void start_recording(const input_log_mode_t mode);
+bool start_replay();
+void stop_replay();
+void frame_done_callback();
 
 int main() {
-  stdio_init_all();
+  hal_init();
   gpio_init_all();
 
-  LedMatrix* led_matrix = &LedMatrix::getInstance();
+#if DUAL_CORE_MODE
+  // core 1 owns input sampling and LED output, it creates both singletons
+  dual_core_launch();
+#endif
+  led_matrix_t* led_matrix = &led_matrix_t::getInstance();
   InputManager* input_manager = &InputManager::getInstance();
+  load_settings();
+  Link::getInstance(); // joins the network first, which can take seconds
+  Audio::getInstance();
+  Oled::getInstance();
+  start_game(0);
+  led_matrix->setRenderDoneCallback(frame_done_callback);
+
+#if !DUAL_CORE_MODE
+  hal_start_periodic(INPUT_SAMPLE_PERIOD_US, input_sample_callback);
+#endif
+
+  Scheduler& scheduler = Scheduler::getInstance();
+  scheduler.addTask(LOGIC_PERIOD_MS * 1000, logic_task);
+  scheduler.addTask(1000000 / RENDER_REFRESH_HZ, render_task);
+  scheduler.addTask(TRACE_DRAIN_PERIOD_MS * 1000, trace_task);
+  scheduler.addTask(STORE_SERVICE_PERIOD_MS * 1000, store_task);
+  scheduler.addTask(CONSOLE_PERIOD_MS * 1000, console_task);
+  scheduler.addTask(OLED_PERIOD_MS * 1000, oled_task);
+  if (Link::getInstance().isUp()) {
+    scheduler.addTask(LINK_PERIOD_MS * 1000, link_task);
+  }
 
-  // struct repeating_timer timer;
-  // add_repeating_timer_ms(UPDATE_STATE_DELAY, update_state_callback, NULL, &timer);
-  while (true) {
-    input_manager->update();
-    update_state();
-    led_matrix->render();
-    sleep_ms(UPDATE_STATE_DELAY);
-    printf("\n");
+#if HAL_HOST
+  // MEMORY_GAME_REPLAY names a log to replay (tools/input_log.py makes them)
+  const char* replay_path = getenv("MEMORY_GAME_REPLAY");
+  if (replay_path != nullptr) {
+    static uint8_t replay_data[sizeof(input_log_header_t) + INPUT_LOG_RECORDS * sizeof(input_log_record_t)];
+    FILE* file = fopen(replay_path, "rb");
+    uint32_t length = file != nullptr ? fread(replay_data, 1, sizeof(replay_data), file) : 0;
+    if (file != nullptr) {
+      fclose(file);
+    }
+    if (!InputLog::getInstance().load(replay_data, length) || !start_replay()) {
+      fprintf(stderr, "MEMORY_GAME_REPLAY: %s is not an input log of this build\n", replay_path);
+      return 1;
+    }
   }
+#endif
+  scheduler.run();
 
   delete led_matrix;
   delete input_manager;
   return 0;
 }
 
-void init_state() {
-  printf("Init state\n");
-  LedMatrix* led_matrix = &LedMatrix::getInstance();
-  led_matrix->setSmile(MAGENTA);
-
-  InputManager& input_manager = InputManager::getInstance();
-
-  if (input_manager.isButtonClicked(SW_PIN)) {
-    current_state = SETTING_STATE;
-    frames_to_remember = MIN_FRAMES;
-  }
+void input_sample_callback() {
+  InputManager::getInstance().sample();
 }
 
-void setting_state() {
-  printf("Setting state\n");
-  LedMatrix* led_matrix = &LedMatrix::getInstance();
+void logic_task() {
   InputManager& input_manager = InputManager::getInstance();
+  input_manager.update();
 
-  if (input_manager.isButtonClicked(SW_PIN)) {
-    current_state = FRAMER_STATE;
-    for (uint8_t i = 0; i < frames_to_remember; i++) {
-      LedMatrix::clear(frames_framer[i]);
-    }
-    current_index_x = 0;
-    current_index_y = 0;
-    current_frame = 0;
-    return;
+  if (replaying && InputLog::getInstance().getMode() != INPUT_LOG_REPLAY) {
+    stop_replay(); // the log ran out
   }
 
-  if (frames_to_remember > MIN_FRAMES) {
-    if (
-      input_manager.isButtonClicked(BTN_A_PIN) || (
-        input_manager.isJoystickXChanged() &&
-        input_manager.getJoystickXDirection() == NEG
-      )
-    ) {
-      frames_to_remember--;
-    }
+  uint64_t last_activity = input_manager.getLastInputTime();
+  last_activity = wake_time > last_activity ? wake_time : last_activity;
+  // a board with a peer stays awake to hear it
+  if (
+    !replaying && !Link::getInstance().isUp() &&
+    hal_time_us() - last_activity > IDLE_TIMEOUT_MS * 1000ull
+  ) {
+    idle();
+    return;
   }
 
-  if (frames_to_remember < MAX_FRAMES) {
-    if (
-      input_manager.isButtonClicked(BTN_B_PIN) || (
-        input_manager.isJoystickXChanged() &&
-        input_manager.getJoystickXDirection() == POS
-      )
-    ) {
-      frames_to_remember++;
-    }
+  // replayed presses carry the edge times of the recording
+  if (photon_press_time == 0 && !replaying) {
+    photon_press_time = input_manager.getFirstPressTime();
   }
-  printf("Frames to remember: %d\n", frames_to_remember);
-
-  led_matrix->setNumber(frames_to_remember, BLUE);
+  update_state((uint64_t)input_manager.getTick() * LOGIC_PERIOD_MS * 1000);
 }
 
-void frame_state() {
-  printf("Frame state\n");
-  InputManager& input_manager = InputManager::getInstance();
+void render_task() {
+  led_matrix_t& led_matrix = led_matrix_t::getInstance();
+  const uint32_t issued = led_matrix.getFramesIssued();
 
-  if (input_manager.isButtonClicked(SW_PIN)) {
-    current_state = REMEMBER_STATE;
-    current_frame = 0;
-    return;
-  }
+  const uint64_t start = hal_time_us();
+  led_matrix.render();
+  latency_record(LATENCY_RENDER, hal_time_us() - start);
 
-  set_frames(frames_framer);
+  if (photon_press_time != 0 && led_matrix.getFramesIssued() != issued) {
+    photon_frame_press_time = photon_press_time;
+    photon_press_time = 0;
+  } else if (photon_press_time != 0 && start - photon_press_time > PHOTON_TIMEOUT_MS * 1000) {
+    photon_press_time = 0; // the press changed nothing, there's no photon to wait for
+  }
 }
 
-void remember_state() {
-  printf("Remember state\n");
-  LedMatrix* led_matrix = &LedMatrix::getInstance();
+// Blocks the game loop from going to sleep until the wake up. Nothing ticks
+// meanwhile: the scheduler is stuck here and the HAL stops input sampling.
+void idle() {
+  led_matrix_t& led_matrix = led_matrix_t::getInstance();
   InputManager& input_manager = InputManager::getInstance();
-
-  if (input_manager.isButtonClicked(SW_PIN)) {
-    current_state = MEMORIZER_STATE;
-    for (uint8_t i = 0; i < frames_to_remember; i++) {
-      LedMatrix::clear(frames_memorizer[i]);
+  TRACE_INFO(TRACE_IDLE, current_state, 0);
+  trace_drain();
+
+  // blank, and let the frame latch before the clocks slow down
+  led_matrix.clear();
+  for (uint8_t i = 0; i < IDLE_BLANK_TRIES; i++) {
+    const uint32_t skipped = led_matrix.getFramesSkipped();
+    led_matrix.render();
+    hal_sleep_until_us(hal_time_us() + IDLE_BLANK_POLL_US);
+    if (led_matrix.getFramesSkipped() != skipped && led_matrix.isRenderDone()) {
+      break;
     }
-    current_index_x = 0;
-    current_index_y = 0;
-    current_frame = 0;
-    return;
   }
 
-  switch_frames();
-
-  led_matrix->setLEDs(frames_framer[current_frame]);
+  const uint64_t sleep_time = hal_time_us();
+  wake_time = hal_idle_until_button();
+#if !DUAL_CORE_MODE
+  input_manager.resume(); // core 1 samples on through the sleep
+#endif
+  wake_frame_time = wake_time;
+  TRACE_INFO(TRACE_WAKE, current_state, (wake_time - sleep_time) / 1000);
+
+  // the press that woke the game up doesn't count as a click
+  input_manager.discard();
+  photon_press_time = 0;
+  redraw_state();
 }
 
-void game_state() {
-  printf("Game state\n");
-  LedMatrix* led_matrix = &LedMatrix::getInstance();
-  InputManager& input_manager = InputManager::getInstance();
-
-  if (input_manager.isButtonClicked(SW_PIN)) {
-    current_state = FINAL_STATE;
-    show_frames_comp = CORRECT;
-    current_frame = 0;
-    return;
+// Runs once the frame has latched (interrupt context, core 1 in DUAL_CORE_MODE)
+void frame_done_callback() {
+  if (wake_frame_time != 0) {
+    latency_record(LATENCY_WAKE_TO_FRAME, hal_time_us() - wake_frame_time);
+    wake_frame_time = 0;
   }
 
-  set_frames(frames_memorizer);
+  const uint64_t press_time = photon_frame_press_time;
+  if (press_time != 0) {
+    latency_record(LATENCY_INPUT_TO_PHOTON, hal_time_us() - press_time);
+    photon_frame_press_time = 0;
+  }
 }
 
-void final_state() {
-  printf("Final state\n");
-  LedMatrix* led_matrix = &LedMatrix::getInstance();
-  InputManager& input_manager = InputManager::getInstance();
-
-  if (input_manager.isButtonClicked(SW_PIN)) {
-    current_state = INIT_STATE;
-  }
+void trace_task() {
+  trace_drain();
+}
 
-  switch_frames();
-
-  switch (show_frames_comp) {
-  case CORRECT:
-    led_matrix->setLEDs(frames_framer[current_frame]);
-    break;
-  case PLAYER:
-    led_matrix->setLEDs(frames_memorizer[current_frame]);
-    break;
-  case COMPARE:
-    if (compare_frames(frames_framer[current_frame], frames_memorizer[current_frame])) {
-      led_matrix->setCheck(GREEN);
-    } else {
-      led_matrix->setCross(RED);
+// Key presses, and the binary commands of Command.h in between
+void console_task() {
+  Command& commands = Command::getInstance();
+  int command;
+  while ((command = hal_stdio_read()) >= 0) {
+    if (commands.receive(command)) {
+      continue;
+    }
+    InputLog& input_log = InputLog::getInstance();
+    switch (command) {
+    case CONSOLE_DUMP_LATENCY:
+      trace_drain();
+      latency_dump();
+      break;
+    case CONSOLE_RECORD:
+      start_recording(INPUT_LOG_RAM);
+      break;
+    case CONSOLE_RECORD_STREAM:
+      trace_drain();
+      start_recording(INPUT_LOG_STREAM);
+      break;
+    case CONSOLE_STOP:
+      input_log.stop();
+      break;
+    case CONSOLE_DUMP_LOG:
+      trace_drain();
+      input_log.dump();
+      break;
+    case CONSOLE_REPLAY:
+      start_replay();
+      break;
+    default:
+      break;
     }
-  default:
-    break;
   }
+}
 
-  if (show_frames_comp == COMPARE) {
-    show_frames_comp = CORRECT;
-  } else {
-    show_frames_comp = (COMPARE_STATE)((int)show_frames_comp + 1); // show_frames_comp++ doesn't work
+// Game time counts logic ticks from 0 again, with the settings in the header
+void start_recording(const input_log_mode_t mode) {
+  if (replaying) {
+    stop_replay();
   }
+  const input_log_header_t header = {
+    INPUT_LOG_MAGIC,
+    INPUT_LOG_VERSION,
+    LOGIC_PERIOD_MS,
+    settings.frames_to_remember,
+    led_matrix_t::getInstance().getBrightness()
+  };
+  InputManager::getInstance().restartTicks();
+  InputLog::getInstance().startRecording(mode, header);
+  start_game(0);
 }
 
-bool update_state() {
-  switch (current_state) {
-  case INIT_STATE:
-    init_state();
-    break;
-  case SETTING_STATE:
-    setting_state();
-    break;
-  case FRAMER_STATE:
-    frame_state();
-    break;
-  case REMEMBER_STATE:
-    remember_state();
-    break;
-  case MEMORIZER_STATE:
-    game_state();
-    break;
-  case FINAL_STATE:
-    final_state();
-    break;
-  default:
-    break;
+bool start_replay() {
+  InputLog& input_log = InputLog::getInstance();
+  if (input_log.getHeader().tick_ms != LOGIC_PERIOD_MS || !input_log.startReplay()) {
+    return false; // other ticks would be other game times
   }
-
+  const input_log_header_t& header = input_log.getHeader();
+  settings.frames_to_remember = header.frames_to_remember;
+  led_matrix_t::getInstance().setBrightness(header.brightness);
+  InputManager::getInstance().restartTicks();
+  start_game(0);
+
+  replaying = true;
+  Scheduler::getInstance().setPeriod(logic_task, LOGIC_PERIOD_MS * 1000 / INPUT_REPLAY_SPEED);
   return true;
 }
 
-void switch_frames() {
-  InputManager& input_manager = InputManager::getInstance();
-
-  if (current_frame > 0) {
-    if (
-      input_manager.isButtonClicked(BTN_A_PIN) || (
-        input_manager.isJoystickXChanged() &&
-        input_manager.getJoystickXDirection() == NEG
-      )
-    ) {
-      current_frame--;
-    }
-  }
-
-  if (current_frame + 1 < frames_to_remember) {
-    if (
-      input_manager.isButtonClicked(BTN_B_PIN) || (
-        input_manager.isJoystickXChanged() &&
-        input_manager.getJoystickXDirection() == POS
-      )
-    ) {
-      current_frame++;
-    }
-  }
+// Back to live input, at the usual pace and with the stored settings
+void stop_replay() {
+  InputLog::getInstance().stop();
+  replaying = false;
+  Scheduler::getInstance().setPeriod(logic_task, LOGIC_PERIOD_MS * 1000);
+  load_settings();
 }
 
-bool compare_frames(
-  COLORS frame1[LED_COUNT_X][LED_COUNT_Y],
-  COLORS frame2[LED_COUNT_X][LED_COUNT_Y]
-) {
-  for (uint8_t i = 0; i < LED_COUNT_X; i++)
-    for (uint8_t j = 0; j < LED_COUNT_Y; j++)
-      if (frame1[i][j] != frame2[i][j])
-        return false;
-  return true;
+void link_task() {
+  Link::getInstance().service();
 }
 
-void set_frames(COLORS current_frames[MAX_FRAMES][LED_COUNT_X][LED_COUNT_Y]) {
-  navigate_leds();
-  InputManager& input_manager = InputManager::getInstance();
-
-  int current_color = current_frames[current_frame][current_index_x][current_index_y];
-  if (input_manager.isButtonClicked(BTN_A_PIN)) {
-    if (current_color > 0) {
-      current_color--;
-    } else {
-      current_color = COLORS_COUNT - 1;
-    }
-  }
-
-  if (input_manager.isButtonClicked(BTN_B_PIN)) {
-    current_color = (current_color + 1) % COLORS_COUNT;
-  }
-  current_frames[current_frame][current_index_x][current_index_y] = (COLORS)current_color;
-
-  static bool blink = false;
-
-  LedMatrix* led_matrix = &LedMatrix::getInstance();
-  led_matrix->setLEDs(current_frames[current_frame]);
-  if (blink) {
-    // current_frames[current_state][current_index_x][current_index_y] == (rgb_t)RGB_BLACK
-    if (
-      current_color == BLACK
-    ) {
-      current_color = WHITE;
-    }
-  } else {
-    current_color = BLACK;
-  }
-  led_matrix->setLED(
-    current_index_x,
-    current_index_y,
-    (COLORS)current_color
-  );
-
-  blink = !blink;
+void oled_task() {
+  status_view_update();
+  Oled::getInstance().service();
 }
 
-void navigate_leds() {
-  InputManager& input_manager = InputManager::getInstance();
-
-  if (input_manager.isJoystickXChanged()) {
-    if (input_manager.getJoystickXDirection() == NEG) {
-      if (current_index_x > 0) {
-        current_index_x--;
-      } else if (current_frame > 0) {
-        current_index_x = LED_COUNT_X - 1;
-        current_frame--;
-      }
-    } else { // jst_x_changed == POS, because jst_x_changed is false when NEUTRAL
-      if (current_index_x + 1 < LED_COUNT_X) {
-        current_index_x++;
-      } else if (current_frame + 1 < frames_to_remember) {
-        current_index_x = 0;
-        current_frame++;
-      }
-    }
-  }
-
-  if (input_manager.isJoystickYChanged()) {
-    if (input_manager.getJoystickYDirection() == NEG) {
-      if (current_index_y > 0) {
-        current_index_y--;
-      } else {
-        current_index_y = LED_COUNT_Y - 1;
-      }
-    } else { // jst_y_changed == POS, because jst_y_changed is false when NEUTRAL
-      if (current_index_y + 1 < LED_COUNT_Y) {
-        current_index_y++;
-      } else {
-        current_index_y = 0;
-      }
-    }
+void store_task() {
+  // sector erases stall the CPU, only do them while nobody is playing
+  if (current_state == INIT_STATE) {
+    FlashStore::getInstance().service();
   }
 }
+
@@ -0,0 +1,117 @@
+#include "Oled.h"
+#include "Glyphs.h"
+
+#include <string.h>
+
+#define OLED_PAGE_HEADER 13 // column and page range commands, then the data control byte
+#define OLED_LINE_TOP 3 // blank rows above the text in the two pages of a line
+
+static_assert(OLED_LINE_CHARS * FONT_ADVANCE * OLED_SCALE <= OLED_WIDTH, "a line fits across");
+static_assert(OLED_LINE_TOP + FONT_HEIGHT * OLED_SCALE <= 16, "a line fits in two pages");
+static_assert(OLED_LINES * 2 <= OLED_PAGES, "the lines fit down");
+static_assert(OLED_PAGE_HEADER + OLED_WIDTH <= HAL_I2C_MAX_WRITE, "a page goes out in one write");
+
+// 128x64, charge pump on, horizontal addressing, column 0 on the left and
+// page 0 at the top, then display on
+static const uint8_t SETUP[] = {
+  0x00, // commands up to the end
+  0xAE, 0xD5, 0x80, 0xA8, 0x3F, 0xD3, 0x00, 0x40, 0x8D, 0x14, 0x20, 0x00,
+  0xA1, 0xC8, 0xDA, 0x12, 0x81, 0xCF, 0xD9, 0xF1, 0xDB, 0x40, 0xA4, 0xA6, 0xAF
+};
+
+// Whatever the display held before reset is sent over
+Oled::Oled() : next_page(0), started(false) {
+  memset(buffer, 0, sizeof(buffer));
+  memset(dirty_first, 0, sizeof(dirty_first));
+  memset(dirty_last, OLED_WIDTH - 1, sizeof(dirty_last));
+  hal_i2c_init(OLED_SDA_PIN, OLED_SCL_PIN, OLED_BAUD);
+}
+
+Oled& Oled::getInstance() {
+  static Oled instance;
+  return instance;
+}
+
+// Bit 0 is the top row of the page
+void Oled::set(const uint8_t page, const uint8_t column, const uint8_t bits) {
+  if (buffer[page][column] == bits) {
+    return;
+  }
+  buffer[page][column] = bits;
+  if (dirty_first[page] > dirty_last[page]) {
+    dirty_first[page] = column;
+    dirty_last[page] = column;
+  } else if (column < dirty_first[page]) {
+    dirty_first[page] = column;
+  } else if (column > dirty_last[page]) {
+    dirty_last[page] = column;
+  }
+}
+
+// The LED font scaled up, left aligned, cut at OLED_LINE_CHARS
+void Oled::drawLine(const uint8_t line, const char* text) {
+  if (line >= OLED_LINES) {
+    return;
+  }
+  const uint8_t page = line * 2;
+  const uint32_t length = strlen(text);
+
+  for (uint32_t x = 0; x < OLED_WIDTH; x++) {
+    const uint32_t column = x / OLED_SCALE;
+    const uint32_t in_glyph = column % FONT_ADVANCE;
+    uint32_t rows = 0; // of both pages, top row first
+    if (column / FONT_ADVANCE < length && in_glyph < FONT_WIDTH) {
+      const uint16_t glyph = FONT[font_index(text[column / FONT_ADVANCE])];
+      const uint32_t bits = (glyph >> (in_glyph * FONT_HEIGHT)) & FONT_COLUMN_MASK;
+      for (uint32_t gy = 0; gy < FONT_HEIGHT; gy++) {
+        if ((bits >> gy) & 1) {
+          // bit 0 of the font is its bottom row
+          rows |= ((1u << OLED_SCALE) - 1) << (OLED_LINE_TOP + (FONT_HEIGHT - 1 - gy) * OLED_SCALE);
+        }
+      }
+    }
+    set(page, x, rows & 0xFF);
+    set(page + 1, x, rows >> 8);
+  }
+}
+
+void Oled::clear() {
+  for (uint8_t page = 0; page < OLED_PAGES; page++) {
+    for (uint8_t column = 0; column < OLED_WIDTH; column++) {
+      set(page, column, 0);
+    }
+  }
+}
+
+// Sends the setup, then the dirty columns of the next dirty page. The bytes
+// are copied for DMA, so the page is clean as soon as the write starts.
+void Oled::service() {
+  if (hal_i2c_busy()) {
+    return;
+  }
+  if (!started) {
+    started = hal_i2c_write(OLED_ADDRESS, SETUP, sizeof(SETUP));
+    return;
+  }
+
+  for (uint8_t i = 0; i < OLED_PAGES; i++) {
+    const uint8_t page = (next_page + i) % OLED_PAGES;
+    const uint8_t first = dirty_first[page];
+    const uint8_t last = dirty_last[page];
+    if (first > last) {
+      continue;
+    }
+    // a control byte with Co set before each command byte, then the data
+    uint8_t data[OLED_PAGE_HEADER + OLED_WIDTH] = {
+      0x80, 0x21, 0x80, first, 0x80, last, 0x80, 0x22, 0x80, page, 0x80, page, 0x40
+    };
+    const uint length = last - first + 1;
+    memcpy(data + OLED_PAGE_HEADER, &buffer[page][first], length);
+    if (hal_i2c_write(OLED_ADDRESS, data, OLED_PAGE_HEADER + length)) {
+      dirty_first[page] = OLED_WIDTH;
+      dirty_last[page] = 0;
+      next_page = (page + 1) % OLED_PAGES;
+    }
+    return;
+  }
+}
@@ -0,0 +1,39 @@
+#ifndef OLED_H
+#define OLED_H
+
+#include "Hal.h"
+
+#define OLED_SDA_PIN 14 // I2C1 of the BitDogLab display header
+#define OLED_SCL_PIN 15
+#define OLED_ADDRESS 0x3C
+#define OLED_BAUD 400000
+#define OLED_WIDTH 128
+#define OLED_PAGES 8 // of 8 rows each
+#define OLED_SCALE 2 // of the LED font, Glyphs.h
+#define OLED_LINES 4 // of text, two pages each
+#define OLED_LINE_CHARS 16
+
+// SSD1306 128x64 display next to the LEDs. Drawing only changes the copy in
+// RAM and widens the columns of the page that changed; service() sends one
+// dirty page at a time over DMA I2C, the bytes that changed and those between
+// them, and returns at once while the bus is still busy with the last one.
+class Oled {
+public:
+  static Oled& getInstance();
+
+  void drawLine(const uint8_t line, const char* text);
+  void clear();
+  void service();
+private:
+  Oled();
+
+  void set(const uint8_t page, const uint8_t column, const uint8_t bits);
+
+  uint8_t buffer[OLED_PAGES][OLED_WIDTH];
+  uint8_t dirty_first[OLED_PAGES]; // columns to send, none when first > last
+  uint8_t dirty_last[OLED_PAGES];
+  uint8_t next_page; // where service() looks first, so no page starves
+  bool started; // the setup commands went out
+};
+
+#endif // OLED_H
@@ -0,0 +1,49 @@
+#include "PuzzlePack.h"
+#include "Game.h"
+
+static_assert(sizeof(puzzle_pack_header_t) == 16 && sizeof(puzzle_pack_entry_t) == 8, "tools/puzzle_pack.py packs these");
+static_assert(sizeof(frame_t) == FRAME_PLANES * frame_t::WORDS * 4, "frames are read in place as bitplanes");
+
+PuzzlePack::PuzzlePack() : header(nullptr), entries(nullptr) {
+  const puzzle_pack_header_t* pack = (const puzzle_pack_header_t*)PUZZLE_PACK_DATA;
+  if (
+    PUZZLE_PACK_SIZE < sizeof(puzzle_pack_header_t) ||
+    pack->magic != PUZZLE_PACK_MAGIC ||
+    pack->version != PUZZLE_PACK_VERSION ||
+    pack->width != LED_COUNT_X ||
+    pack->height != LED_COUNT_Y ||
+    pack->planes != FRAME_PLANES ||
+    pack->size != PUZZLE_PACK_SIZE ||
+    sizeof(puzzle_pack_header_t) + pack->puzzles * sizeof(puzzle_pack_entry_t) > PUZZLE_PACK_SIZE
+  ) {
+    return;
+  }
+  header = pack;
+  entries = (const puzzle_pack_entry_t*)(PUZZLE_PACK_DATA + sizeof(puzzle_pack_header_t));
+}
+
+PuzzlePack& PuzzlePack::getInstance() {
+  static PuzzlePack instance;
+  return instance;
+}
+
+uint16_t PuzzlePack::getCount() {
+  return header != nullptr ? header->puzzles : 0;
+}
+
+// Frames of a puzzle, where they are in flash. nullptr for a puzzle the game
+// can't play, too long or running past the end of the pack.
+const frame_t* PuzzlePack::getPuzzle(const uint16_t index, uint8_t* frames) {
+  if (index >= getCount()) {
+    return nullptr;
+  }
+  const puzzle_pack_entry_t& entry = entries[index];
+  if (
+    entry.frames < MIN_FRAMES || entry.frames > MAX_FRAMES || entry.offset % 4 != 0 ||
+    entry.offset > PUZZLE_PACK_SIZE || entry.frames * sizeof(frame_t) > PUZZLE_PACK_SIZE - entry.offset
+  ) {
+    return nullptr;
+  }
+  *frames = entry.frames;
+  return (const frame_t*)(PUZZLE_PACK_DATA + entry.offset);
+}
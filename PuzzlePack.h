@@ -0,0 +1,51 @@
+#ifndef PUZZLE_PACK_H
+#define PUZZLE_PACK_H
+
+#include "Frame.h"
+
+// Read-only sequences to remember, compiled from text or image files by
+// tools/puzzle_pack.py and linked in as const data. On the board that leaves
+// them in flash, where the game reads the frames in place through XIP: a pack
+// costs no RAM however many puzzles it holds.
+//
+// A pack is a puzzle_pack_header_t, an index of puzzle_pack_entry_t and then
+// the frames of every puzzle as frame_t bitplanes, little endian and aligned
+// to 4. A pack made for another panel size is ignored.
+#define PUZZLE_PACK_MAGIC 0x5050474D // "MGPP"
+#define PUZZLE_PACK_VERSION 1
+
+struct puzzle_pack_header_t {
+  uint32_t magic;
+  uint8_t version;
+  uint8_t width;
+  uint8_t height;
+  uint8_t planes;
+  uint16_t puzzles;
+  uint16_t reserved;
+  uint32_t size; // bytes in the whole pack
+};
+
+struct puzzle_pack_entry_t {
+  uint32_t offset; // of the first frame, from the start of the pack
+  uint8_t frames;
+  uint8_t reserved[3];
+};
+
+// The pack linked in, made by tools/puzzle_pack.py --cpp at build time
+extern const uint8_t PUZZLE_PACK_DATA[];
+extern const uint32_t PUZZLE_PACK_SIZE;
+
+class PuzzlePack {
+public:
+  static PuzzlePack& getInstance();
+
+  uint16_t getCount();
+  const frame_t* getPuzzle(const uint16_t index, uint8_t* frames);
+private:
+  PuzzlePack();
+
+  const puzzle_pack_header_t* header; // nullptr when the pack doesn't fit this build
+  const puzzle_pack_entry_t* entries;
+};
+
+#endif // PUZZLE_PACK_H
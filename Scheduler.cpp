@@ -0,0 +1,58 @@
+#include "Scheduler.h"
+
+Scheduler::Scheduler() : tasks(), task_count(0) {}
+
+Scheduler& Scheduler::getInstance() {
+  static Scheduler instance;
+  return instance;
+}
+
+bool Scheduler::addTask(const uint32_t period_us, task_callback_t callback) {
+  if (task_count >= SCHEDULER_MAX_TASKS || period_us == 0) {
+    return false;
+  }
+  tasks[task_count++] = {period_us, hal_time_us(), callback};
+  return true;
+}
+
+// Takes effect after the next run of the task
+bool Scheduler::setPeriod(task_callback_t callback, const uint32_t period_us) {
+  for (uint8_t i = 0; i < task_count; i++) {
+    if (tasks[i].callback == callback && period_us > 0) {
+      tasks[i].period_us = period_us;
+      return true;
+    }
+  }
+  return false;
+}
+
+void Scheduler::runPending() {
+  uint64_t now = hal_time_us();
+  for (uint8_t i = 0; i < task_count; i++) {
+    task_t& task = tasks[i];
+    if (task.next_run_us > now) {
+      continue;
+    }
+    task.callback();
+
+    task.next_run_us += task.period_us;
+    if (task.next_run_us <= now) {
+      // fell behind by a whole period, drop the missed runs instead of bursting
+      task.next_run_us = now + task.period_us;
+    }
+  }
+}
+
+void Scheduler::run() {
+  while (true) {
+    runPending();
+
+    uint64_t next_run_us = tasks[0].next_run_us;
+    for (uint8_t i = 1; i < task_count; i++) {
+      if (tasks[i].next_run_us < next_run_us) {
+        next_run_us = tasks[i].next_run_us;
+      }
+    }
+    hal_sleep_until_us(next_run_us);
+  }
+}
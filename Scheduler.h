@@ -0,0 +1,34 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include "Hal.h"
+
+#define SCHEDULER_MAX_TASKS 8
+
+typedef void (*task_callback_t)();
+
+struct task_t {
+  uint64_t period_us;
+  uint64_t next_run_us;
+  task_callback_t callback;
+};
+
+// Cooperative fixed-rate scheduler for the main loop. Each task keeps its own
+// period, deadlines advance by whole periods so they don't drift, and the core
+// sleeps until the earliest deadline.
+class Scheduler {
+public:
+  static Scheduler& getInstance();
+
+  bool addTask(const uint32_t period_us, task_callback_t callback);
+  bool setPeriod(task_callback_t callback, const uint32_t period_us);
+  void runPending();
+  void run();
+private:
+  Scheduler();
+
+  task_t tasks[SCHEDULER_MAX_TASKS];
+  uint8_t task_count;
+};
+
+#endif // SCHEDULER_H
@@ -0,0 +1,44 @@
+#include "Scoring.h"
+
+void score_frame(const frame_t& expected, const frame_t& played, frame_score_t* score) {
+  score->wrong = expected.diff(played);
+  score->correct_pixels = LED_COUNT - score->wrong.count();
+  score->accuracy = score->correct_pixels * 100 / LED_COUNT;
+
+  // one mask per colour on each side, then a popcount per pair
+  frame_mask_t expected_masks[COLORS_COUNT], played_masks[COLORS_COUNT];
+  for (uint8_t c = 0; c < COLORS_COUNT; c++) {
+    expected_masks[c] = expected.colorMask((COLORS)c);
+    played_masks[c] = played.colorMask((COLORS)c);
+  }
+  for (uint8_t e = 0; e < COLORS_COUNT; e++) {
+    for (uint8_t p = 0; p < COLORS_COUNT; p++) {
+      score->confusion[e][p] = (expected_masks[e] & played_masks[p]).count();
+    }
+  }
+}
+
+void score_session(
+  const frame_t* expected,
+  const frame_t* played,
+  const uint8_t frames,
+  frame_score_t* frame_scores,
+  session_score_t* session
+) {
+  uint32_t correct_pixels = 0;
+  *session = {frames, 0, 0, 0};
+  for (uint8_t i = 0; i < frames; i++) {
+    frame_score_t* score = &frame_scores[i];
+    score_frame(expected[i], played[i], score);
+
+    correct_pixels += score->correct_pixels;
+    session->total += score->correct_pixels * SCORE_PIXEL_POINTS;
+    if (!score->wrong.any()) {
+      session->perfect_frames++;
+      session->total += SCORE_PERFECT_BONUS;
+    }
+  }
+  if (frames > 0) {
+    session->accuracy = correct_pixels * 100 / (frames * LED_COUNT);
+  }
+}
@@ -0,0 +1,34 @@
+#ifndef SCORING_H
+#define SCORING_H
+
+#include "Frame.h"
+
+#define SCORE_PIXEL_POINTS 10 // per pixel right
+#define SCORE_PERFECT_BONUS 100 // per frame without a mistake
+
+struct frame_score_t {
+  frame_mask_t wrong; // pixels the player got wrong
+  uint16_t correct_pixels;
+  uint8_t accuracy; // percent of the pixels right
+  uint16_t confusion[COLORS_COUNT][COLORS_COUNT]; // pixels by [expected][played] colour, the diagonal is right
+};
+
+struct session_score_t {
+  uint8_t frames;
+  uint8_t perfect_frames;
+  uint8_t accuracy; // percent of the pixels right over all frames
+  uint32_t total; // points
+};
+
+// Scores every frame in one pass over the bitplanes, meant to run once when a
+// game ends so the results can be shown without comparing frames again.
+void score_frame(const frame_t& expected, const frame_t& played, frame_score_t* score);
+void score_session(
+  const frame_t* expected,
+  const frame_t* played,
+  const uint8_t frames,
+  frame_score_t* frame_scores,
+  session_score_t* session
+);
+
+#endif // SCORING_H
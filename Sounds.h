@@ -0,0 +1,56 @@
+#ifndef SOUNDS_H
+#define SOUNDS_H
+
+#include <stdint.h>
+
+// 125 MHz / 8000: the DMA timer paces samples off the system clock exactly
+#define AUDIO_SAMPLE_RATE 15625
+#define SOUND_MAX_NOTES 4
+#define SOUND_CLICK_SAMPLES 160 // 10 ms
+#define SOUND_CLICK_HZ 3000
+
+enum SOUNDS {
+  SOUND_CLICK,  // a button press the game took
+  SOUND_MOVE,   // a joystick step the game took
+  SOUND_STATE,  // change of state
+  SOUND_CHECK,  // FINAL_STATE verdict, frame remembered
+  SOUND_CROSS,  // FINAL_STATE verdict, frame wrong
+  SOUNDS_COUNT
+};
+
+struct sound_note_t {
+  uint16_t frequency; // Hz, 0 is a rest
+  uint16_t duration_ms; // 0 ends the sound
+};
+
+// A clip of levels played as is, or square wave notes one after the other
+struct sound_t {
+  const uint8_t* clip;
+  uint16_t clip_length; // samples at AUDIO_SAMPLE_RATE
+  uint8_t volume; // peak level, out of HAL_AUDIO_LEVELS
+  sound_note_t notes[SOUND_MAX_NOTES];
+};
+
+// A tick: a square wave dying away, built at compile time
+struct ClickClip {
+  uint8_t levels[SOUND_CLICK_SAMPLES];
+
+  constexpr ClickClip() : levels() {
+    for (uint32_t i = 0; i < SOUND_CLICK_SAMPLES; i++) {
+      const bool high = (i * SOUND_CLICK_HZ * 2 / AUDIO_SAMPLE_RATE) % 2 == 0;
+      levels[i] = high ? 255 * (SOUND_CLICK_SAMPLES - i) / SOUND_CLICK_SAMPLES : 0;
+    }
+  }
+};
+
+constexpr ClickClip CLICK_CLIP = {};
+
+constexpr sound_t SOUNDS_ARRAY[SOUNDS_COUNT] = {
+  {CLICK_CLIP.levels, SOUND_CLICK_SAMPLES, 96, {}},           // SOUND_CLICK
+  {nullptr, 0, 48, {{1800, 15}}},                             // SOUND_MOVE
+  {nullptr, 0, 64, {{880, 40}, {1320, 60}}},                  // SOUND_STATE
+  {nullptr, 0, 80, {{1047, 80}, {1319, 80}, {1568, 120}}},    // SOUND_CHECK
+  {nullptr, 0, 80, {{220, 120}, {0, 40}, {165, 200}}}         // SOUND_CROSS
+};
+
+#endif // SOUNDS_H
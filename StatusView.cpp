@@ -0,0 +1,59 @@
+#include "StatusView.h"
+#include "Oled.h"
+#include "Game.h"
+
+#include <stdio.h>
+#include <string.h>
+
+// In state_t order, in the letters of the font (Glyphs.h)
+static const char* const STATE_NAMES[STATES_COUNT] = {
+  "READY", "SETTING", "FRAMER", "REMEMBER", "MEMORIZER", "RESULTS", "PEER TURN"
+};
+
+static_assert(MAX_FRAMES <= 99, "PERFECT %u OF %u fits OLED_LINE_CHARS");
+
+#define STATUS_MAX_POINTS 999999 // six digits keep the score line in OLED_LINE_CHARS
+
+static char shown[OLED_LINES][OLED_LINE_CHARS + 1]; // blank, like the display after reset
+
+void status_view_update() {
+  game_status_t status;
+  game_status(&status);
+  char lines[OLED_LINES][OLED_LINE_CHARS + 1] = {};
+
+  snprintf(lines[0], sizeof(lines[0]), "%s", STATE_NAMES[status.state]);
+  switch (status.state) {
+  case INIT_STATE:
+  case SETTING_STATE:
+    snprintf(lines[1], sizeof(lines[1]), "FRAMES %u", frames_to_remember);
+    break;
+  case FRAMER_STATE:
+  case MEMORIZER_STATE:
+  case REMEMBER_STATE:
+    snprintf(lines[1], sizeof(lines[1]), "FRAME %u OF %u", status.frame + 1, frames_to_remember);
+    if (status.cursor) {
+      snprintf(lines[2], sizeof(lines[2]), "X %u Y %u", status.x, status.y);
+    }
+    break;
+  case FINAL_STATE:
+    snprintf(lines[1], sizeof(lines[1]), "FRAME %u OF %u", status.frame + 1, frames_to_remember);
+    // two digits each fill the line exactly
+    snprintf(lines[2], sizeof(lines[2]), "PERFECT %u OF %u",
+      session_score.perfect_frames < MAX_FRAMES ? session_score.perfect_frames : MAX_FRAMES,
+      session_score.frames < MAX_FRAMES ? session_score.frames : MAX_FRAMES);
+    snprintf(lines[3], sizeof(lines[3]), "%lu PTS %u%%",
+      (unsigned long)(session_score.total < STATUS_MAX_POINTS ? session_score.total : STATUS_MAX_POINTS),
+      session_score.accuracy);
+    break;
+  default:
+    break;
+  }
+
+  Oled& oled = Oled::getInstance();
+  for (uint8_t line = 0; line < OLED_LINES; line++) {
+    if (strcmp(lines[line], shown[line]) != 0) {
+      oled.drawLine(line, lines[line]);
+      strcpy(shown[line], lines[line]);
+    }
+  }
+}
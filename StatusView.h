@@ -0,0 +1,9 @@
+#ifndef STATUS_VIEW_H
+#define STATUS_VIEW_H
+
+// The game in words on the OLED (Oled.h): the state, the frame looked at out
+// of frames_to_remember, the cursor and, once scored, the results. Lines that
+// read the same as last time aren't drawn again.
+void status_view_update();
+
+#endif // STATUS_VIEW_H
@@ -0,0 +1,43 @@
+#include "Trace.h"
+#include "RingBuffer.h"
+
+static RingBuffer<trace_record_t, TRACE_BUFFER_SIZE> trace_buffer;
+static uint32_t trace_dropped = 0;
+
+void trace_write(const trace_id_t id, const uint16_t arg0, const uint32_t arg1) {
+  trace_record_t record = {TRACE_SYNC, (uint8_t)id, arg0, (uint32_t)hal_time_us(), arg1};
+
+  // interrupt handlers may trace too, keep the ring single-producer
+  uint32_t irq_state = hal_irq_save();
+  if (!trace_buffer.push(record)) {
+    trace_dropped++;
+  }
+  hal_irq_restore(irq_state);
+}
+
+void trace_drain() {
+  trace_record_t record;
+  for (uint8_t i = 0; i < TRACE_DRAIN_BUDGET && trace_buffer.pop(record); i++) {
+    hal_stdio_write(&record, sizeof(record));
+  }
+
+  if (trace_dropped > 0) {
+    uint32_t irq_state = hal_irq_save();
+    uint32_t dropped = trace_dropped;
+    trace_dropped = 0;
+    hal_irq_restore(irq_state);
+
+    record = {TRACE_SYNC, TRACE_DROPPED, 0, (uint32_t)hal_time_us(), dropped};
+    hal_stdio_write(&record, sizeof(record));
+  }
+}
+
+void trace_send(const trace_id_t id, const uint16_t arg0, const uint32_t arg1) {
+  trace_record_t record = {TRACE_SYNC, (uint8_t)id, arg0, (uint32_t)hal_time_us(), arg1};
+  hal_stdio_write(&record, sizeof(record));
+}
+
+void trace_send_at(const trace_id_t id, const uint32_t time_us, const uint16_t arg0, const uint32_t arg1) {
+  trace_record_t record = {TRACE_SYNC, (uint8_t)id, arg0, time_us, arg1};
+  hal_stdio_write(&record, sizeof(record));
+}
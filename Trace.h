@@ -0,0 +1,75 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include "Hal.h"
+
+// Compact binary trace. Call sites write fixed-size records into a RAM ring,
+// trace_drain() sends them over stdio (USB CDC) from the main loop and
+// tools/trace_decode.py turns a captured stream back into text. Records above
+// TRACE_LEVEL compile away.
+#define TRACE_LEVEL_OFF 0
+#define TRACE_LEVEL_ERROR 1
+#define TRACE_LEVEL_WARN 2
+#define TRACE_LEVEL_INFO 3
+#define TRACE_LEVEL_DEBUG 4
+
+#ifndef TRACE_LEVEL
+#define TRACE_LEVEL TRACE_LEVEL_INFO
+#endif
+
+#define TRACE_SYNC 0xA5
+#define TRACE_BUFFER_SIZE 128 // records, power of two
+#define TRACE_DRAIN_BUDGET 16 // records sent per trace_drain()
+
+// Keep in sync with TRACE_IDS in tools/trace_decode.py
+enum trace_id_t {
+  TRACE_DROPPED,         // arg1: records lost because the ring was full
+  TRACE_INPUT,           // arg0: pressed buttons (A | B << 1 | SW << 2), arg1: X | Y << 8 directions
+  TRACE_STATE_TICK,      // arg0: state_t
+  TRACE_STATE_CHANGE,    // arg0: new state_t, arg1: previous state_t
+  TRACE_FRAMES_TO_REMEMBER, // arg0: frames
+  TRACE_STORE_ROTATE,    // arg0: sector the log moved to, arg1: its sequence
+  TRACE_STORE_ERASE,     // arg0: sector, arg1: time taken in us
+  TRACE_SCORE,           // arg0: perfect frames | frames << 8, arg1: total points
+  TRACE_LATENCY_MAX,     // arg0: latency_id_t, arg1: longest sample in us, starts a histogram
+  TRACE_LATENCY_BUCKET,  // arg0: latency_id_t | bucket << 8, arg1: samples
+  TRACE_IDLE,            // arg0: state_t, going to sleep
+  TRACE_WAKE,            // arg0: state_t, arg1: ms asleep
+  TRACE_LINK_TURN,       // arg0: state_t handed to the peer | 0x100 when received, arg1: frames
+  TRACE_LINK_RESEND,     // arg0: oldest sequence number, arg1: messages sent again
+  TRACE_INPUT_LOG_START, // arg0: version | tick ms << 8, arg1: frames to remember | brightness << 8
+  TRACE_INPUT_LOG,       // time: edge time, arg0: pin | value << 8, arg1: logic tick
+  TRACE_REPLAY_END,      // arg1: logic ticks replayed
+  TRACE_PUZZLE,          // arg0: puzzle of the pack, arg1: frames
+  TRACE_IDS_COUNT
+};
+
+struct __attribute__((packed)) trace_record_t {
+  uint8_t sync;
+  uint8_t id;
+  uint16_t arg0;
+  uint32_t time_us;
+  uint32_t arg1;
+};
+
+void trace_write(const trace_id_t id, const uint16_t arg0, const uint32_t arg1);
+void trace_drain();
+// Sends a record at once, bypassing the ring and TRACE_LEVEL, for dumps
+// made from the same loop that calls trace_drain()
+void trace_send(const trace_id_t id, const uint16_t arg0, const uint32_t arg1);
+// trace_send() for records that carry a time of their own
+void trace_send_at(const trace_id_t id, const uint32_t time_us, const uint16_t arg0, const uint32_t arg1);
+
+#define TRACE(level, id, arg0, arg1) \
+  do { \
+    if ((level) <= TRACE_LEVEL) { \
+      trace_write((id), (arg0), (arg1)); \
+    } \
+  } while (0)
+
+#define TRACE_ERROR(id, arg0, arg1) TRACE(TRACE_LEVEL_ERROR, id, arg0, arg1)
+#define TRACE_WARN(id, arg0, arg1) TRACE(TRACE_LEVEL_WARN, id, arg0, arg1)
+#define TRACE_INFO(id, arg0, arg1) TRACE(TRACE_LEVEL_INFO, id, arg0, arg1)
+#define TRACE_DEBUG(id, arg0, arg1) TRACE(TRACE_LEVEL_DEBUG, id, arg0, arg1)
+
+#endif // TRACE_H
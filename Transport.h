@@ -0,0 +1,29 @@
+#ifndef TRANSPORT_H
+#define TRANSPORT_H
+
+#include "Hal.h"
+
+// Unreliable datagrams to one peer board, what the two-player Link is built
+// on. TransportPicoW.cpp sends UDP over the Pico W radio (lwIP),
+// TransportHost.cpp over localhost sockets so two simulators can play each
+// other. Opt-in on the board (MEMORY_GAME_LINK in CMake), always built into
+// the simulator.
+#ifndef LINK_MODE
+#define LINK_MODE 0
+#endif
+
+#define TRANSPORT_MTU 256 // largest datagram sent or received
+
+#if LINK_MODE
+// Returns false when there is no peer configured or it can't be reached
+bool transport_open();
+bool transport_send(const uint8_t* data, uint32_t length);
+// Returns the length of the oldest datagram waiting, -1 when there is none
+int32_t transport_receive(uint8_t* data, uint32_t max_length);
+#else
+inline bool transport_open() { return false; }
+inline bool transport_send(const uint8_t*, uint32_t) { return false; }
+inline int32_t transport_receive(uint8_t*, uint32_t) { return -1; }
+#endif
+
+#endif // TRANSPORT_H
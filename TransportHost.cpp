@@ -0,0 +1,73 @@
+// Host backend of Transport.h: UDP over localhost. MEMORY_GAME_LINK names the
+// ports as <local port>:<peer port>, two simulators started with mirrored
+// ports play each other. Their virtual clocks then follow the wall clock, so
+// neither runs ahead of the other. MEMORY_GAME_LINK_LOSS drops that percentage
+// of the datagrams sent, to exercise the resends.
+
+#include "Transport.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+static int transport_socket = -1;
+static sockaddr_in peer_address;
+static unsigned loss_percent = 0;
+static uint32_t loss_state = 1; // xorshift, the same losses on every run
+
+bool transport_open() {
+  const char* ports = getenv("MEMORY_GAME_LINK");
+  unsigned local_port, peer_port;
+  if (ports == nullptr || sscanf(ports, "%u:%u", &local_port, &peer_port) != 2) {
+    return false;
+  }
+
+  transport_socket = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0);
+  if (transport_socket < 0) {
+    perror("MEMORY_GAME_LINK");
+    return false;
+  }
+  sockaddr_in local_address = {};
+  local_address.sin_family = AF_INET;
+  local_address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  local_address.sin_port = htons(local_port);
+  if (bind(transport_socket, (const sockaddr*)&local_address, sizeof(local_address)) < 0) {
+    perror("MEMORY_GAME_LINK");
+    close(transport_socket);
+    transport_socket = -1;
+    return false;
+  }
+
+  peer_address = {};
+  peer_address.sin_family = AF_INET;
+  peer_address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  peer_address.sin_port = htons(peer_port);
+  const char* loss = getenv("MEMORY_GAME_LINK_LOSS");
+  loss_percent = loss != nullptr ? atoi(loss) : 0;
+  hal_host_realtime_mode();
+  return true;
+}
+
+bool transport_send(const uint8_t* data, uint32_t length) {
+  if (transport_socket < 0) {
+    return false;
+  }
+  loss_state ^= loss_state << 13;
+  loss_state ^= loss_state >> 17;
+  loss_state ^= loss_state << 5;
+  if (loss_state % 100 < loss_percent) {
+    return true; // lost on the way
+  }
+  return sendto(transport_socket, data, length, 0, (const sockaddr*)&peer_address, sizeof(peer_address)) == (ssize_t)length;
+}
+
+int32_t transport_receive(uint8_t* data, uint32_t max_length) {
+  if (transport_socket < 0) {
+    return -1;
+  }
+  ssize_t length = recv(transport_socket, data, max_length, 0);
+  return length < 0 ? -1 : (int32_t)length;
+}
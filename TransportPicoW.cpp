@@ -0,0 +1,94 @@
+// Pico W backend of Transport.h: UDP over the CYW43 radio with lwIP in poll
+// mode, so every callback runs inside transport_receive() on the game loop.
+// The network and the peer come from CMake (LINK_WIFI_SSID and friends),
+// both boards use the same port.
+
+#include "Transport.h"
+
+#include <string.h>
+#include "pico/cyw43_arch.h"
+#include "lwip/pbuf.h"
+#include "lwip/udp.h"
+
+#ifndef LINK_PORT
+#define LINK_PORT 4242
+#endif
+#define LINK_CONNECT_TIMEOUT_MS 10000
+#define TRANSPORT_RX_SLOTS 8 // datagrams, power of two
+
+struct transport_datagram_t {
+  uint16_t length;
+  uint8_t data[TRANSPORT_MTU];
+};
+
+static udp_pcb* transport_pcb = nullptr;
+static ip_addr_t peer_address;
+static transport_datagram_t rx_slots[TRANSPORT_RX_SLOTS];
+static uint8_t rx_head = 0, rx_tail = 0;
+
+static void udp_received(void* arg, udp_pcb* pcb, pbuf* p, const ip_addr_t* address, u16_t port) {
+  (void)arg;
+  (void)pcb;
+  (void)port;
+  // anything but the peer is dropped, so are datagrams that find the ring full
+  if (ip_addr_cmp(address, &peer_address) && (uint8_t)(rx_head - rx_tail) < TRANSPORT_RX_SLOTS) {
+    transport_datagram_t& slot = rx_slots[rx_head % TRANSPORT_RX_SLOTS];
+    slot.length = pbuf_copy_partial(p, slot.data, TRANSPORT_MTU, 0);
+    rx_head++;
+  }
+  pbuf_free(p);
+}
+
+bool transport_open() {
+  if (cyw43_arch_init()) {
+    return false;
+  }
+  cyw43_arch_enable_sta_mode();
+  if (
+    cyw43_arch_wifi_connect_timeout_ms(
+      LINK_WIFI_SSID, LINK_WIFI_PASSWORD, CYW43_AUTH_WPA2_AES_PSK, LINK_CONNECT_TIMEOUT_MS
+    ) != 0 ||
+    !ipaddr_aton(LINK_PEER_IP, &peer_address)
+  ) {
+    cyw43_arch_deinit();
+    return false;
+  }
+
+  transport_pcb = udp_new();
+  if (transport_pcb == nullptr || udp_bind(transport_pcb, IP_ADDR_ANY, LINK_PORT) != ERR_OK) {
+    cyw43_arch_deinit();
+    transport_pcb = nullptr;
+    return false;
+  }
+  udp_recv(transport_pcb, udp_received, nullptr);
+  return true;
+}
+
+bool transport_send(const uint8_t* data, uint32_t length) {
+  if (transport_pcb == nullptr) {
+    return false;
+  }
+  pbuf* p = pbuf_alloc(PBUF_TRANSPORT, length, PBUF_RAM);
+  if (p == nullptr) {
+    return false;
+  }
+  memcpy(p->payload, data, length);
+  err_t err = udp_sendto(transport_pcb, p, &peer_address, LINK_PORT);
+  pbuf_free(p);
+  return err == ERR_OK;
+}
+
+int32_t transport_receive(uint8_t* data, uint32_t max_length) {
+  if (transport_pcb == nullptr) {
+    return -1;
+  }
+  cyw43_arch_poll();
+  if (rx_tail == rx_head) {
+    return -1;
+  }
+  const transport_datagram_t& slot = rx_slots[rx_tail % TRANSPORT_RX_SLOTS];
+  uint32_t length = slot.length < max_length ? slot.length : max_length;
+  memcpy(data, slot.data, length);
+  rx_tail++;
+  return length;
+}
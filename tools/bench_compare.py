@@ -0,0 +1,59 @@
+#!/usr/bin/env python3
+"""Compare a benchmark run (Memory_game_bench output) against a baseline.
+
+Usage: bench_compare.py baseline.csv current.csv [--threshold PERCENT]
+
+Cases slower than the baseline by more than the threshold (default 10%) are
+regressions and make the exit status 1. Cycles are compared when both runs
+have them (the board), ns otherwise (the host).
+"""
+import argparse
+import csv
+import sys
+
+
+def load(path):
+    with open(path, newline="") as file:
+        return {row["name"]: row for row in csv.DictReader(file)}
+
+
+def cost(row, use_cycles):
+    return float(row["cycles_per_iteration" if use_cycles else "ns_per_iteration"])
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("baseline")
+    parser.add_argument("current")
+    parser.add_argument("--threshold", type=float, default=10.0, help="allowed slowdown in percent")
+    args = parser.parse_args()
+
+    baseline = load(args.baseline)
+    current = load(args.current)
+    use_cycles = all(
+        float(row["cycles_per_iteration"]) > 0
+        for rows in (baseline, current) for row in rows.values()
+    )
+    unit = "cycles" if use_cycles else "ns"
+
+    regressions = 0
+    print(f"{'case':<20} {'baseline':>12} {'current':>12} {'change':>8}  ({unit})")
+    for name, row in current.items():
+        if name not in baseline:
+            print(f"{name:<20} {'-':>12} {cost(row, use_cycles):>12.1f}     new")
+            continue
+        before, after = cost(baseline[name], use_cycles), cost(row, use_cycles)
+        change = (after - before) / before * 100 if before > 0 else 0.0
+        flag = ""
+        if change > args.threshold:
+            flag = "  REGRESSION"
+            regressions += 1
+        print(f"{name:<20} {before:>12.1f} {after:>12.1f} {change:>+7.1f}%{flag}")
+    for name in baseline.keys() - current.keys():
+        print(f"{name:<20} missing from the current run")
+
+    return 1 if regressions else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
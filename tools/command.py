@@ -0,0 +1,220 @@
+#!/usr/bin/env python3
+"""Drive the game with the binary commands of Command.h.
+
+Usage: command.py [--port /dev/ttyACM0 | --out message.bin] command [args...]
+       command.py [--width 5] [--height 5] replies capture.bin
+
+Commands:
+  hello                                   panel size and limits
+  read-frames framer|memorizer|solution [first] [count]
+  write-frames framer|memorizer source [first]
+  input A=1 A=0 SW=1 X=POS Y=NEUTRAL ...  buttons pressed (1) or released (0),
+                                          joystick directions, for the next tick
+  state INIT|SETTING|FRAMER|REMEMBER|MEMORIZER|FINAL|PEER [frames]
+  counters
+
+write-frames takes the first puzzle of a tools/puzzle_pack.py source, text
+or PPM, so a whole sequence goes over in one message. With --port the answer
+is read back and shown, trace records in between are skipped. --out writes
+the message to a file instead, for a "send" line of a simulator script; the
+answers then end up in MEMORY_GAME_TRACE, which "replies" shows.
+"""
+import argparse
+import os
+import struct
+import sys
+import time
+
+from puzzle_pack import LETTERS, FRAME_PLANES, parse_ppm, parse_text, pack_frame
+from trace_decode import RECORD, STATES, TRACE_SYNC
+
+COMMAND_SYNC = 0xC5
+COMMAND_REPLY = 0x80
+HEADER = struct.Struct("<BBH")  # sync, type, payload length
+HELLO = struct.Struct("<BBBBBH")  # version, width, height, planes, max frames, frame size
+COUNTERS = struct.Struct("<IIIIBBBBIHH")
+# Keep in sync with command_type_t, command_error_t and command_frames_t in Command.h
+TYPES = {"hello": 1, "read-frames": 2, "write-frames": 3, "input": 4, "state": 5, "counters": 6}
+ERROR = 0x7F
+ERRORS = ["bad CRC", "bad type", "bad length", "bad argument", "busy"]
+SETS = ["framer", "memorizer", "solution"]
+# Keep in sync with GPIO.h
+PINS = {"A": 5, "B": 6, "SW": 22, "X": 27, "Y": 26}
+DIRECTIONS = ["POS", "NEG", "NEUTRAL"]
+REPLY_TIMEOUT_S = 2
+
+
+def crc16(data, crc=0xFFFF):
+    """CRC-16/CCITT-FALSE, as Command.cpp computes it."""
+    for byte in data:
+        crc ^= byte << 8
+        for _ in range(8):
+            crc = (crc << 1) ^ 0x1021 if crc & 0x8000 else crc << 1
+        crc &= 0xFFFF
+    return crc
+
+
+def message(command_type, payload=b""):
+    body = HEADER.pack(COMMAND_SYNC, command_type, len(payload))[1:] + payload
+    return bytes([COMMAND_SYNC]) + body + struct.pack("<H", crc16(body))
+
+
+def replies(data):
+    """(type, payload) of every answer in a stream, stepping over trace records."""
+    offset = 0
+    while offset + HEADER.size + 2 <= len(data):
+        if data[offset] == TRACE_SYNC and offset + RECORD.size <= len(data):
+            offset += RECORD.size
+            continue
+        if data[offset] != COMMAND_SYNC:
+            offset += 1
+            continue
+        _, reply_type, length = HEADER.unpack_from(data, offset)
+        end = offset + HEADER.size + length
+        if end + 2 > len(data):
+            return
+        body = data[offset + 1:end]
+        if struct.unpack_from("<H", data, end)[0] != crc16(body):
+            offset += 1  # a sync byte inside something else
+            continue
+        yield reply_type, data[offset + HEADER.size:end]
+        offset = end + 2
+
+
+def unpack_frames(data, count, width, height):
+    words = (width * height + 31) // 32
+    frame_size = FRAME_PLANES * words * 4
+    frames = []
+    for frame in range(count):
+        planes = [struct.unpack_from(f"<{words}I", data, frame * frame_size + plane * words * 4)
+                  for plane in range(FRAME_PLANES)]
+        rows = []
+        for y in reversed(range(height)):  # the top row is the highest y
+            pixels = [y * width + x for x in range(width)]
+            rows.append("".join(LETTERS[sum((planes[p][i // 32] >> i % 32 & 1) << p
+                                            for p in range(FRAME_PLANES))] for i in pixels))
+        frames.append(rows)
+    return frames
+
+
+def describe(reply_type, payload, size):
+    if reply_type == ERROR:
+        command = next((name for name, value in TYPES.items() if value == payload[0]), str(payload[0]))
+        reason = ERRORS[payload[1]] if payload[1] < len(ERRORS) else str(payload[1])
+        return f"error: {command}: {reason}"
+    name = next((name for name, value in TYPES.items() if value == reply_type & ~COMMAND_REPLY), None)
+    if name == "hello":
+        version, width, height, planes, max_frames, frame_size = HELLO.unpack(payload)
+        return (f"version {version}, {width}x{height}, {planes} planes, up to {max_frames} frames "
+                f"of {frame_size} bytes")
+    if name == "counters":
+        (time_ms, ticks, issued, skipped, state, frames, perfect, accuracy, score,
+         commands, errors) = COUNTERS.unpack(payload)
+        state = STATES[state] if state < len(STATES) else str(state)
+        return (f"{time_ms / 1000:.3f} s, tick {ticks}, LED frames {issued} ({skipped} skipped)\n"
+                f"{state}, {frames} frames, last score {score} ({perfect} perfect, {accuracy}%)\n"
+                f"{commands} commands, {errors} errors")
+    if name == "read-frames":
+        frame_set, first, count = payload[:3]
+        lines = [f"{SETS[frame_set]} frames {first} to {first + count - 1}"]
+        for number, rows in enumerate(unpack_frames(payload[3:], count, *size)):
+            lines += [f"frame {first + number}"] + rows + [""]
+        return "\n".join(lines)
+    return f"{name or reply_type}: done"
+
+
+def build(args, size):
+    """The message for the command line."""
+    width, height = size
+    values = args.args
+    if args.command in ("hello", "counters"):
+        return message(TYPES[args.command])
+    if args.command == "read-frames":
+        first = int(values[1]) if len(values) > 1 else 0
+        count = int(values[2]) if len(values) > 2 else 1
+        return message(TYPES["read-frames"], bytes([SETS.index(values[0]), first, count]))
+    if args.command == "write-frames":
+        source = values[1]
+        first = int(values[2]) if len(values) > 2 else 0
+        if source.lower().endswith((".ppm", ".pnm")):
+            puzzles = parse_ppm(source, width, height)
+        else:
+            puzzles = parse_text(source, width, height)
+        if not puzzles:
+            sys.exit(f"{source}: no puzzle")
+        frames = b"".join(pack_frame(rows, width, height) for rows in puzzles[0])
+        payload = bytes([SETS.index(values[0]), first, len(puzzles[0])]) + frames
+        return message(TYPES["write-frames"], payload)
+    if args.command == "input":
+        payload = b""
+        for value in values:
+            pin, _, level = value.upper().partition("=")
+            level = DIRECTIONS.index(level) if pin in ("X", "Y") else int(level)
+            payload += bytes([PINS[pin], level])
+        return message(TYPES["input"], payload)
+    if args.command == "state":
+        frames = int(values[1]) if len(values) > 1 else 0
+        return message(TYPES["state"], bytes([STATES.index(values[0].upper()), frames]))
+    sys.exit(f"unknown command {args.command}")
+
+
+class Port:
+    """A serial port in raw mode, read without blocking."""
+
+    def __init__(self, path):
+        import termios
+        import tty
+        self.fd = os.open(path, os.O_RDWR | os.O_NOCTTY | os.O_NONBLOCK)
+        tty.setraw(self.fd, termios.TCSANOW)
+        self.received = b""
+
+    def request(self, data):
+        os.write(self.fd, data)
+        deadline = time.monotonic() + REPLY_TIMEOUT_S
+        while time.monotonic() < deadline:
+            try:
+                self.received += os.read(self.fd, 4096)
+            except BlockingIOError:
+                time.sleep(0.01)
+            answers = list(replies(self.received))
+            if answers:
+                self.received = b""
+                return answers[0]
+        sys.exit("no answer")
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    target = parser.add_mutually_exclusive_group()
+    target.add_argument("--port", help="serial port of the board")
+    target.add_argument("--out", help="write the message to a file instead")
+    parser.add_argument("--width", type=int, default=5, help="panel width, without --port")
+    parser.add_argument("--height", type=int, default=5, help="panel height, without --port")
+    parser.add_argument("command", choices=list(TYPES) + ["replies"])
+    parser.add_argument("args", nargs="*")
+    args = parser.parse_args()
+
+    size = (args.width, args.height)
+    if args.command == "replies":
+        with open(args.args[0], "rb") as file:
+            for reply_type, payload in replies(file.read()):
+                if reply_type == TYPES["hello"] | COMMAND_REPLY:
+                    size = HELLO.unpack(payload)[1:3]
+                print(describe(reply_type, payload, size))
+        return
+    if args.out:
+        with open(args.out, "wb") as file:
+            file.write(build(args, size))
+        return
+    if not args.port:
+        parser.error("--port or --out")
+    port = Port(args.port)
+    reply_type, payload = port.request(message(TYPES["hello"]))
+    if reply_type == TYPES["hello"] | COMMAND_REPLY:
+        size = HELLO.unpack(payload)[1:3]
+    reply_type, payload = port.request(build(args, size))
+    print(describe(reply_type, payload, size))
+
+
+if __name__ == "__main__":
+    main()
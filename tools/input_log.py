@@ -0,0 +1,94 @@
+#!/usr/bin/env python3
+"""Turn the input log in a captured trace stream into a replayable log file.
+
+Usage: input_log.py extract capture.bin session.log
+       input_log.py show session.log
+
+The log is the last one in the capture, streamed while recording (console
+'s') or dumped from RAM (console 'd'). Replay it in the simulator with
+MEMORY_GAME_REPLAY=session.log. The format is in InputLog.h.
+"""
+import argparse
+import struct
+import sys
+
+from trace_decode import RECORD, TRACE_SYNC, TRACE_IDS
+
+INPUT_LOG_MAGIC = 0x4E49474D
+INPUT_LOG_PIN_GAP = 0xFF
+HEADER = struct.Struct("<IBBBB")  # magic, version, tick ms, frames to remember, brightness
+LOG_RECORD = struct.Struct("<HBBI")  # ticks since the previous record, pin, value, edge time
+LOG_START = [name for name, _ in TRACE_IDS].index("INPUT_LOG_START")
+LOG_INPUT = [name for name, _ in TRACE_IDS].index("INPUT_LOG")
+
+
+def records(data):
+    """Trace records in a capture, resyncing on stray bytes like the decoder."""
+    offset = 0
+    while offset + RECORD.size <= len(data):
+        if data[offset] != TRACE_SYNC:
+            offset += 1
+            continue
+        yield RECORD.unpack_from(data, offset)
+        offset += RECORD.size
+
+
+def extract(capture, output):
+    with open(capture, "rb") as file:
+        data = file.read()
+    header = None
+    inputs = []
+    for _, trace_id, arg0, time_us, arg1 in records(data):
+        if trace_id == LOG_START:
+            header = HEADER.pack(INPUT_LOG_MAGIC, arg0 & 0xFF, arg0 >> 8, arg1 & 0xFF, arg1 >> 8)
+            inputs = []
+        elif trace_id == LOG_INPUT and header is not None:
+            inputs.append((arg1, arg0 & 0xFF, arg0 >> 8, time_us))
+    if header is None:
+        sys.exit(f"{capture}: no input log")
+
+    with open(output, "wb") as file:
+        file.write(header)
+        last_tick = 0
+        for tick, pin, value, time_us in inputs:
+            while tick - last_tick > 0xFFFF:
+                file.write(LOG_RECORD.pack(0xFFFF, INPUT_LOG_PIN_GAP, 0, 0))
+                last_tick += 0xFFFF
+            file.write(LOG_RECORD.pack(tick - last_tick, pin, value, time_us))
+            last_tick = tick
+    print(f"{output}: {len(inputs)} inputs over {last_tick} ticks")
+
+
+def show(path):
+    with open(path, "rb") as file:
+        data = file.read()
+    magic, version, tick_ms, frames, brightness = HEADER.unpack_from(data)
+    if magic != INPUT_LOG_MAGIC:
+        sys.exit(f"{path}: not an input log")
+    print(f"version {version}, {tick_ms} ms ticks, {frames} frames, brightness {brightness}")
+    tick = 0
+    for offset in range(HEADER.size, len(data) - LOG_RECORD.size + 1, LOG_RECORD.size):
+        ticks, pin, value, time_us = LOG_RECORD.unpack_from(data, offset)
+        tick += ticks
+        if pin != INPUT_LOG_PIN_GAP:
+            print(f"tick {tick:8}  pin {pin:2} = {value}  edge {time_us / 1e6:.6f}")
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    commands = parser.add_subparsers(dest="command", required=True)
+    extract_parser = commands.add_parser("extract")
+    extract_parser.add_argument("capture")
+    extract_parser.add_argument("output")
+    show_parser = commands.add_parser("show")
+    show_parser.add_argument("log")
+    args = parser.parse_args()
+
+    if args.command == "extract":
+        extract(args.capture, args.output)
+    else:
+        show(args.log)
+
+
+if __name__ == "__main__":
+    main()
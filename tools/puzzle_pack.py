@@ -0,0 +1,216 @@
+#!/usr/bin/env python3
+"""Compile puzzle files into a puzzle pack, or show what is in one.
+
+Usage: puzzle_pack.py build [--width 5] [--height 5] [--cpp] output [source...]
+       puzzle_pack.py show pack.bin
+
+A text source holds any number of puzzles. A line starting with "puzzle"
+begins one, its frames follow as rows of one letter per pixel, top row first,
+with a blank line between frames: . W R G B Y C M for black, white, red,
+green, blue, yellow, cyan and magenta. '#' starts a comment. A PPM image
+(P3 or P6) is one puzzle, its frames stacked from top to bottom, and every
+channel counts as lit from 128 up.
+
+--cpp writes the pack as C++ source defining PUZZLE_PACK_DATA and
+PUZZLE_PACK_SIZE, which the build links in. The format is in PuzzlePack.h.
+"""
+import argparse
+import os
+import struct
+import sys
+
+PUZZLE_PACK_MAGIC = 0x5050474D
+PUZZLE_PACK_VERSION = 1
+FRAME_PLANES = 3
+MAX_FRAMES = 32  # Game.h
+HEADER = struct.Struct("<IBBBBHHI")  # magic, version, width, height, planes, puzzles, reserved, size
+ENTRY = struct.Struct("<IB3x")  # offset of the first frame, frames
+
+# Keep in sync with COLORS in Frame.h
+LETTERS = ".WRGBYCM"
+# COLORS by lit channels, r << 2 | g << 1 | b
+CHANNELS = [0, 4, 3, 6, 2, 7, 5, 1]
+
+
+def parse_text(path, width, height):
+    """Puzzles of a text source, each a list of frames of height rows of colours."""
+    puzzles = []
+    rows = []
+
+    def end_frame(line_number):
+        if not rows:
+            return
+        if len(rows) != height:
+            sys.exit(f"{path}:{line_number}: a frame has {height} rows, not {len(rows)}")
+        if not puzzles:
+            sys.exit(f"{path}:{line_number}: frame before the first puzzle line")
+        puzzles[-1].append(list(rows))
+        rows.clear()
+
+    number = 0
+    with open(path) as file:
+        for number, line in enumerate(file, 1):
+            line = line.split("#", 1)[0].strip()
+            if line.startswith("puzzle"):
+                end_frame(number)
+                puzzles.append([])
+            elif not line:
+                end_frame(number)
+            elif len(line) != width or any(c.upper() not in LETTERS for c in line):
+                sys.exit(f"{path}:{number}: rows are {width} of {LETTERS}")
+            else:
+                rows.append([LETTERS.index(c.upper()) for c in line])
+        end_frame(number + 1)
+    return puzzles
+
+
+def read_ppm(path):
+    """Width, height and (r, g, b) rows of a P3 or P6 image."""
+    with open(path, "rb") as file:
+        data = file.read()
+    fields = []
+    offset = 0
+    while len(fields) < 4:
+        while data[offset:offset + 1].isspace():
+            offset += 1
+        if data[offset:offset + 1] == b"#":
+            offset = data.index(b"\n", offset)
+            continue
+        end = offset
+        while end < len(data) and not data[end:end + 1].isspace():
+            end += 1
+        fields.append(data[offset:end])
+        offset = end
+    magic, width, height, maximum = fields[0], int(fields[1]), int(fields[2]), int(fields[3])
+    if magic == b"P6" and maximum < 256:
+        values = list(data[offset + 1:offset + 1 + width * height * 3])
+    elif magic == b"P3":
+        values = [int(value) for value in data[offset:].split()]
+    else:
+        sys.exit(f"{path}: only P3 and 8-bit P6 images")
+    if len(values) < width * height * 3:
+        sys.exit(f"{path}: image data is short")
+    pixels = [tuple(values[i:i + 3]) for i in range(0, width * height * 3, 3)]
+    return width, height, [pixels[y * width:(y + 1) * width] for y in range(height)], maximum
+
+
+def parse_ppm(path, width, height):
+    image_width, image_height, rows, maximum = read_ppm(path)
+    if image_width != width or image_height % height != 0:
+        sys.exit(f"{path}: frames are {width}x{height}, stacked from top to bottom")
+    half = (maximum + 1) // 2
+    colours = [
+        [CHANNELS[(r >= half) << 2 | (g >= half) << 1 | (b >= half)] for r, g, b in row]
+        for row in rows
+    ]
+    return [[colours[y:y + height] for y in range(0, image_height, height)]]
+
+
+def pack_frame(rows, width, height):
+    """frame_t bitplanes: plane p holds bit p of the colour of pixel y * width + x."""
+    words = (width * height + 31) // 32
+    planes = [[0] * words for _ in range(FRAME_PLANES)]
+    for row_number, row in enumerate(rows):
+        y = height - 1 - row_number  # the top row is the highest y
+        for x, colour in enumerate(row):
+            pixel = y * width + x
+            for plane in range(FRAME_PLANES):
+                if colour >> plane & 1:
+                    planes[plane][pixel // 32] |= 1 << pixel % 32
+    return b"".join(struct.pack(f"<{words}I", *plane) for plane in planes)
+
+
+def build(sources, width, height):
+    puzzles = []
+    for source in sources:
+        if source.lower().endswith((".ppm", ".pnm")):
+            puzzles += parse_ppm(source, width, height)
+        else:
+            puzzles += parse_text(source, width, height)
+    for number, frames in enumerate(puzzles):
+        if not 1 <= len(frames) <= MAX_FRAMES:
+            sys.exit(f"puzzle {number}: {len(frames)} frames, the game plays 1 to {MAX_FRAMES}")
+    if len(puzzles) > 0xFFFF:
+        sys.exit(f"{len(puzzles)} puzzles, a pack holds up to 65535")
+
+    offset = HEADER.size + ENTRY.size * len(puzzles)
+    entries = b""
+    frames_data = b""
+    for frames in puzzles:
+        entries += ENTRY.pack(offset + len(frames_data), len(frames))
+        frames_data += b"".join(pack_frame(rows, width, height) for rows in frames)
+    size = offset + len(frames_data)
+    header = HEADER.pack(PUZZLE_PACK_MAGIC, PUZZLE_PACK_VERSION, width, height, FRAME_PLANES,
+                         len(puzzles), 0, size)
+    return header + entries + frames_data, len(puzzles)
+
+
+def write_cpp(path, pack, sources):
+    lines = [
+        f"// Made by tools/puzzle_pack.py from {', '.join(map(os.path.basename, sources)) or 'nothing'}, don't edit",
+        '#include "PuzzlePack.h"',
+        "",
+        "// const, so it stays in flash",
+        "alignas(4) const uint8_t PUZZLE_PACK_DATA[] = {",
+    ]
+    for offset in range(0, len(pack), 16):
+        lines.append("  " + " ".join(f"0x{byte:02x}," for byte in pack[offset:offset + 16]))
+    lines += ["};", f"const uint32_t PUZZLE_PACK_SIZE = {len(pack)};", ""]
+    with open(path, "w") as file:
+        file.write("\n".join(lines))
+
+
+def show(path):
+    with open(path, "rb") as file:
+        data = file.read()
+    magic, version, width, height, planes, puzzles, _, size = HEADER.unpack_from(data)
+    if magic != PUZZLE_PACK_MAGIC or planes != FRAME_PLANES:
+        sys.exit(f"{path}: not a puzzle pack")
+    print(f"version {version}, {width}x{height}, {puzzles} puzzles, {size} bytes")
+    words = (width * height + 31) // 32
+    frame_size = FRAME_PLANES * words * 4
+    for number in range(puzzles):
+        offset, frames = ENTRY.unpack_from(data, HEADER.size + number * ENTRY.size)
+        print(f"puzzle {number}")
+        for frame in range(frames):
+            start = offset + frame * frame_size
+            planes_words = [struct.unpack_from(f"<{words}I", data, start + plane * words * 4)
+                            for plane in range(FRAME_PLANES)]
+            for y in reversed(range(height)):
+                row = ""
+                for x in range(width):
+                    pixel = y * width + x
+                    colour = sum((planes_words[plane][pixel // 32] >> pixel % 32 & 1) << plane
+                                 for plane in range(FRAME_PLANES))
+                    row += LETTERS[colour]
+                print(row)
+            print()
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    commands = parser.add_subparsers(dest="command", required=True)
+    build_parser = commands.add_parser("build")
+    build_parser.add_argument("--width", type=int, default=5)
+    build_parser.add_argument("--height", type=int, default=5)
+    build_parser.add_argument("--cpp", action="store_true", help="write C++ source instead of a binary")
+    build_parser.add_argument("output")
+    build_parser.add_argument("sources", nargs="*")
+    show_parser = commands.add_parser("show")
+    show_parser.add_argument("pack")
+    args = parser.parse_args()
+
+    if args.command == "show":
+        show(args.pack)
+        return
+    pack, count = build(args.sources, args.width, args.height)
+    if args.cpp:
+        write_cpp(args.output, pack, args.sources)
+    else:
+        with open(args.output, "wb") as file:
+            file.write(pack)
+    print(f"{args.output}: {count} puzzles, {len(pack)} bytes")
+
+
+if __name__ == "__main__":
+    main()
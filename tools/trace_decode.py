@@ -0,0 +1,107 @@
+#!/usr/bin/env python3
+"""Decode the binary trace stream written by Trace.cpp.
+
+Usage: trace_decode.py [capture.bin | /dev/ttyACM0]  (reads stdin by default)
+"""
+import struct
+import sys
+
+TRACE_SYNC = 0xA5
+RECORD = struct.Struct("<BBHII")  # sync, id, arg0, time_us, arg1
+COMMAND_SYNC = 0xC5  # answers to tools/command.py share the stream, Command.h
+COMMAND_HEADER = struct.Struct("<BBH")  # sync, type, payload length, then payload and CRC
+COMMAND_MAX_PAYLOAD = 4096  # well over any answer, a longer one is a stray sync byte
+
+STATES = ["INIT", "SETTING", "FRAMER", "REMEMBER", "MEMORIZER", "FINAL", "PEER"]
+DIRECTIONS = ["POS", "NEG", "NEUTRAL"]
+LATENCY_BUCKETS = 20  # Latency.h
+# Keep in sync with latency_id_t in Latency.h
+LATENCIES = [
+    "INIT_STATE", "SETTING_STATE", "FRAMER_STATE", "REMEMBER_STATE", "MEMORIZER_STATE",
+    "FINAL_STATE", "PEER_STATE", "RENDER", "SAMPLE_JITTER", "INPUT_TO_PHOTON", "WAKE_TO_FRAME",
+]
+
+
+def state(value):
+    return STATES[value] if value < len(STATES) else str(value)
+
+
+def direction(value):
+    return DIRECTIONS[value] if value < len(DIRECTIONS) else str(value)
+
+
+def latency(value):
+    return LATENCIES[value] if value < len(LATENCIES) else str(value)
+
+
+def bucket(value):
+    # bucket 0 is 0 us, bucket b is [2^(b-1), 2^b) us, the last one everything longer
+    if value == 0:
+        return "0 us"
+    if value == LATENCY_BUCKETS - 1:
+        return f"{1 << (value - 1)}+ us"
+    return f"{1 << (value - 1)}-{(1 << value) - 1} us"
+
+
+# Keep in sync with trace_id_t in Trace.h
+TRACE_IDS = [
+    ("DROPPED", lambda a0, a1: f"{a1} records lost"),
+    ("INPUT", lambda a0, a1: f"A: {a0 & 1}, B: {a0 >> 1 & 1}, SW: {a0 >> 2 & 1}, "
+                             f"X: {direction(a1 & 0xFF)}, Y: {direction(a1 >> 8 & 0xFF)}"),
+    ("STATE_TICK", lambda a0, a1: state(a0)),
+    ("STATE_CHANGE", lambda a0, a1: f"{state(a1)} -> {state(a0)}"),
+    ("FRAMES_TO_REMEMBER", lambda a0, a1: str(a0)),
+    ("STORE_ROTATE", lambda a0, a1: f"sector {a0}, sequence {a1}"),
+    ("STORE_ERASE", lambda a0, a1: f"sector {a0}, {a1} us"),
+    ("SCORE", lambda a0, a1: f"{a0 & 0xFF}/{a0 >> 8} perfect frames, {a1} points"),
+    ("LATENCY_MAX", lambda a0, a1: f"{latency(a0)}: max {a1} us"),
+    ("LATENCY_BUCKET", lambda a0, a1: f"{latency(a0 & 0xFF)}: {bucket(a0 >> 8)}: {a1}"),
+    ("IDLE", lambda a0, a1: f"in {state(a0)}"),
+    ("WAKE", lambda a0, a1: f"in {state(a0)} after {a1} ms"),
+    ("LINK_TURN", lambda a0, a1: f"{'from' if a0 >> 8 else 'to'} peer: {state(a0 & 0xFF)}, {a1} frames"),
+    ("LINK_RESEND", lambda a0, a1: f"{a1} messages from sequence {a0}"),
+    ("INPUT_LOG_START", lambda a0, a1: f"version {a0 & 0xFF}, {a0 >> 8} ms ticks, "
+                                       f"{a1 & 0xFF} frames, brightness {a1 >> 8}"),
+    ("INPUT_LOG", lambda a0, a1: f"tick {a1}: pin {a0 & 0xFF} = {a0 >> 8}"),
+    ("REPLAY_END", lambda a0, a1: f"after {a1} ticks"),
+    ("PUZZLE", lambda a0, a1: f"puzzle {a0}, {a1} frames"),
+]
+
+
+def decode(stream):
+    buffer = b""
+    while True:
+        chunk = stream.read(RECORD.size)
+        if not chunk:
+            return
+        buffer += chunk
+        while len(buffer) >= RECORD.size:
+            payload = COMMAND_HEADER.unpack_from(buffer)[2]
+            if buffer[0] == COMMAND_SYNC and payload <= COMMAND_MAX_PAYLOAD:
+                length = COMMAND_HEADER.size + payload + 2
+                if len(buffer) < length:
+                    break  # the rest of the answer is still to come
+                buffer = buffer[length:]
+                continue
+            if buffer[0] != TRACE_SYNC:
+                buffer = buffer[1:]  # resync on the next sync byte
+                continue
+            _, trace_id, arg0, time_us, arg1 = RECORD.unpack_from(buffer)
+            buffer = buffer[RECORD.size:]
+            if trace_id < len(TRACE_IDS):
+                name, describe = TRACE_IDS[trace_id]
+                print(f"{time_us / 1e6:12.6f} {name:<20} {describe(arg0, arg1)}", flush=True)
+            else:
+                print(f"{time_us / 1e6:12.6f} #{trace_id:<19} {arg0} {arg1}", flush=True)
+
+
+def main():
+    if len(sys.argv) > 1:
+        with open(sys.argv[1], "rb", buffering=0) as stream:
+            decode(stream)
+    else:
+        decode(sys.stdin.buffer)
+
+
+if __name__ == "__main__":
+    main()